@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#include "analyze.h"
+#include "filter.h"
+#include "parallel.h"
+
+using namespace reader;
+using namespace std;
+
+#define NUM_SIZE_CLASSES	8
+
+bool Analyze::doAnalyze()
+{
+	if (!archive.open() || !archive.readIndex())
+		return false;
+
+	const vector<struct INDEX *>& entries = archive.getEntries();
+	uint32_t numBlocks = archive.getNumBlocks();
+	vector<CHAIN> chains(entries.size());
+
+	parallelFor(entries.size(), [&](size_t i)
+	{
+		followChain(entries[i]->ublock, chains[i]);
+	}, threads);
+
+	vector<bool> used(numBlocks, false);
+	size_t dataBlocks = 0, runs = 0, fragmented = 0, damaged = 0, slack = 0;
+	uint32_t indexRuns = 0;
+	size_t sizeCount[NUM_SIZE_CLASSES] = {0};
+	size_t typeCount[5] = {0}, typeBytes[5] = {0};
+
+	if (numBlocks > 0)
+		used[0] = true;
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		const struct USAGE_BLOCK *ub = entries[i]->ublock;
+		used[ub->thisBlock] = true;
+
+		if (i == 0 || ub->thisBlock != entries[i-1]->ublock->thisBlock + 1)
+			indexRuns++;
+
+		for (auto itr = chains[i].blocks.begin(); itr != chains[i].blocks.end(); ++itr)
+		{
+			if (!used[*itr])
+				dataBlocks++;
+
+			used[*itr] = true;
+		}
+
+		runs += chains[i].runs;
+		slack += (size_t)ub->sizeBlocks * SIZE_PAYLOAD - min((size_t)ub->sizeBlocks * SIZE_PAYLOAD, (size_t)ub->sizeBytes);
+
+		if (chains[i].runs > 1)
+			fragmented++;
+
+		if (chains[i].damaged)
+			damaged++;
+
+		// Size classes: up to 512 bytes, 2 KiB, 8 KiB, ... and larger
+		size_t cls = 0;
+
+		for (size_t limit = SIZE_PAYLOAD; ub->sizeBytes > limit && cls < NUM_SIZE_CLASSES - 1; limit *= 4)
+			cls++;
+
+		sizeCount[cls]++;
+
+		int type = 0;
+
+		for (int t = EntryFilter::entryType(ub->filePath); t > 1; t >>= 1)
+			type++;
+
+		typeCount[type]++;
+		typeBytes[type] += ub->sizeBytes;
+	}
+
+	size_t unused = 0;
+
+	for (uint32_t b = 0; b < numBlocks; ++b)
+	{
+		if (!used[b])
+			unused++;
+	}
+
+	cout << "File:                " << archive.getFileName() << endl;
+	cout << "Size:                " << archive.getFileSize() << " bytes in " << numBlocks << " blocks" << endl;
+	cout << "Entries:             " << entries.size() << endl;
+	cout << "Index blocks:        " << entries.size() << " in " << indexRuns << " runs" << endl;
+	cout << "Data blocks:         " << dataBlocks << endl;
+	cout << "Unreferenced blocks: " << unused << " (" << percent(unused, numBlocks) << ")" << endl;
+	cout << "Unused payload:      " << slack << " bytes in the last blocks of the chains" << endl;
+	cout << "Fragmented entries:  " << fragmented << " of " << entries.size() << " (" << percent(fragmented, entries.size()) << ")" << endl;
+	cout << "Runs:                " << runs << ", average length " << fixed << setprecision(1)
+		 << (runs ? (double)dataBlocks / runs : 0.0) << " blocks" << defaultfloat << endl;
+
+	if (damaged)
+		cout << "Damaged chains:      " << damaged << " (use --verify for details)" << endl;
+
+	cout << endl << "Entry sizes:" << endl;
+	size_t limit = SIZE_PAYLOAD;
+
+	for (size_t i = 0; i < NUM_SIZE_CLASSES; ++i, limit *= 4)
+	{
+		string label;
+
+		if (i == NUM_SIZE_CLASSES - 1)
+			label = "larger";
+		else if (limit < 1024)
+			label = "<= " + to_string(limit) + " B";
+		else if (limit < 1024 * 1024)
+			label = "<= " + to_string(limit / 1024) + " KiB";
+		else
+			label = "<= " + to_string(limit / (1024 * 1024)) + " MiB";
+
+		cout << "  " << left << setw(12) << label << right << setw(8) << sizeCount[i] << endl;
+	}
+
+	const char *typeNames[] = { "xml", "image", "sound", "font", "other" };
+	cout << endl << "Entry types:" << endl;
+
+	for (int i = 0; i < 5; ++i)
+		cout << "  " << left << setw(12) << typeNames[i] << right << setw(8) << typeCount[i] << setw(14) << typeBytes[i] << " bytes" << endl;
+
+	return true;
+}
+
+/*
+ * Follows the chain of \p ub and counts the runs of consecutive blocks.
+ * The chain ends at the first block that can't belong to it.
+ */
+void Analyze::followChain(const struct USAGE_BLOCK *ub, CHAIN& chain)
+{
+	unsigned char memblock[SIZE_BLOCK] = {0};
+	BlockView block(memblock);
+	uint32_t nextBlock = ub->startBlock;
+	uint32_t numBlocks = archive.getNumBlocks();
+
+	for (uint32_t i = 0; i < ub->sizeBlocks; i++)
+	{
+		if (nextBlock == 0 || nextBlock >= numBlocks || chain.blocks.size() > numBlocks ||
+				!archive.readBlock(nextBlock, memblock) || block.thisBlock() != nextBlock)
+		{
+			chain.damaged = true;
+			return;
+		}
+
+		if (chain.blocks.empty() || nextBlock != chain.blocks.back() + 1)
+			chain.runs++;
+
+		chain.blocks.push_back(nextBlock);
+		nextBlock = block.nextBlock();
+	}
+}
+
+string Analyze::percent(size_t part, size_t total)
+{
+	stringstream s;
+	s << fixed << setprecision(1) << (total ? 100.0 * part / total : 0.0) << " %";
+	return s.str();
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+#ifndef __ANALYZE_H__
+#define __ANALYZE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "archive.h"
+
+namespace reader
+{
+	/**
+	 * Prints a report about the layout of an FSF file: How fragmented the
+	 * chains are, how long the runs of consecutive blocks are, how many
+	 * blocks are not used and a histogram of the entry sizes and types.
+	 * The chains are followed in parallel. Nothing is decoded.
+	 */
+	class Analyze
+	{
+		struct CHAIN
+		{
+			uint32_t runs{0};			// Runs of consecutive blocks
+			bool damaged{false};
+			std::vector<uint32_t> blocks;
+		};
+
+		Archive archive;
+		unsigned threads{0};
+
+		public:
+			explicit Analyze(const std::string& fn, const OPTIONS& opts = OPTIONS())
+				: archive{fn, opts}
+			{}
+
+			bool doAnalyze();
+			void setThreads(unsigned t) { threads = t; }
+
+		private:
+			void followChain(const struct USAGE_BLOCK *ub, CHAIN& chain);
+			static std::string percent(size_t part, size_t total);
+	};
+}
+
+#endif
@@ -0,0 +1,977 @@
+/*
+ * Copyright (C) 2019, 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "expand.h"
+#include "scramble.h"
+#include "parallel.h"
+#include "trace.h"
+
+using namespace reader;
+using namespace std;
+
+typedef struct
+{
+	unsigned char ch;
+	short byte;
+}CHTABLE;
+
+static CHTABLE __cht[] = {
+	{0x80,	0x20AC},
+	{0x81,	0x0081},
+	{0x82,	0x201A},
+	{0x83,	0x0192},
+	{0x84,	0x201E},
+	{0x85,	0x2026},
+	{0x86,	0x2020},
+	{0x87,	0x2021},
+	{0x88,	0x02C6},
+	{0x89,	0x2030},
+	{0x8A,	0x0160},
+	{0x8B,	0x2039},
+	{0x8C,	0x0152},
+	{0x8D,	0x008d},
+	{0x8E,	0x017D},
+	{0x8F,	0x008f},
+	{0x90,	0x0090},
+	{0x91,	0x2018},
+	{0x92,	0x2019},
+	{0x93,	0x201C},
+	{0x94,	0x201D},
+	{0x95,	0x2022},
+	{0x96,	0x2013},
+	{0x97,	0x2014},
+	{0x98,	0x02DC},
+	{0x99,	0x2122},
+	{0x9A,	0x0161},
+	{0x9B,	0x203A},
+	{0x9C,	0x0153},
+	{0x9D,	0x009d},
+	{0x9E,	0x017E},
+	{0x9F,	0x0178},
+	{0xA0,	0x00A0},
+	{0xA1,	0x00A1},
+	{0xA2,	0x00A2},
+	{0xA3,	0x00A3},
+	{0xA4,	0x00A4},
+	{0xA5,	0x00A5},
+	{0xA6,	0x00A6},
+	{0xA7,	0x00A7},
+	{0xA8,	0x00A8},
+	{0xA9,	0x00A9},
+	{0xAA,	0x00AA},
+	{0xAB,	0x00AB},
+	{0xAC,	0x00AC},
+	{0xAD,	0x00AD},
+	{0xAE,	0x00AE},
+	{0xAF,	0x00AF},
+	{0xB0,	0x00B0},
+	{0xB1,	0x00B1},
+	{0xB2,	0x00B2},
+	{0xB3,	0x00B3},
+	{0xB4,	0x00B4},
+	{0xB5,	0x00B5},
+	{0xB6,	0x00B6},
+	{0xB7,	0x00B7},
+	{0xB8,	0x00B8},
+	{0xB9,	0x00B9},
+	{0xBA,	0x00BA},
+	{0xBB,	0x00BB},
+	{0xBC,	0x00BC},
+	{0xBD,	0x00BD},
+	{0xBE,	0x00BE},
+	{0xBF,	0x00BF},
+	{0xC0,	0x00C0},
+	{0xC1,	0x00C1},
+	{0xC2,	0x00C2},
+	{0xC3,	0x00C3},
+	{0xC4,	0x00C4},
+	{0xC5,	0x00C5},
+	{0xC6,	0x00C6},
+	{0xC7,	0x00C7},
+	{0xC8,	0x00C8},
+	{0xC9,	0x00C9},
+	{0xCA,	0x00CA},
+	{0xCB,	0x00CB},
+	{0xCC,	0x00CC},
+	{0xCD,	0x00CD},
+	{0xCE,	0x00CE},
+	{0xCF,	0x00CF},
+	{0xD0,	0x00D0},
+	{0xD1,	0x00D1},
+	{0xD2,	0x00D2},
+	{0xD3,	0x00D3},
+	{0xD4,	0x00D4},
+	{0xD5,	0x00D5},
+	{0xD6,	0x00D6},
+	{0xD7,	0x00D7},
+	{0xD8,	0x00D8},
+	{0xD9,	0x00D9},
+	{0xDA,	0x00DA},
+	{0xDB,	0x00DB},
+	{0xDC,	0x00DC},
+	{0xDD,	0x00DD},
+	{0xDE,	0x00DE},
+	{0xDF,	0x00DF},
+	{0xE0,	0x00E0},
+	{0xE1,	0x00E1},
+	{0xE2,	0x00E2},
+	{0xE3,	0x00E3},
+	{0xE4,	0x00E4},
+	{0xE5,	0x00E5},
+	{0xE6,	0x00E6},
+	{0xE7,	0x00E7},
+	{0xE8,	0x00E8},
+	{0xE9,	0x00E9},
+	{0xEA,	0x00EA},
+	{0xEB,	0x00EB},
+	{0xEC,	0x00EC},
+	{0xED,	0x00ED},
+	{0xEE,	0x00EE},
+	{0xEF,	0x00EF},
+	{0xF0,	0x00F0},
+	{0xF1,	0x00F1},
+	{0xF2,	0x00F2},
+	{0xF3,	0x00F3},
+	{0xF4,	0x00F4},
+	{0xF5,	0x00F5},
+	{0xF6,	0x00F6},
+	{0xF7,	0x00F7},
+	{0xF8,	0x00F8},
+	{0xF9,	0x00F9},
+	{0xFA,	0x00FA},
+	{0xFB,	0x00FB},
+	{0xFC,	0x00FC},
+	{0xFD,	0x00FD},
+	{0xFE,	0x00FE},
+	{0xFF,	0x00FF}
+};
+
+Archive::~Archive()
+{
+	deleteIndex();
+	close();
+}
+
+bool Archive::open()
+{
+	if (fd >= 0)
+		return true;
+
+	if (fname.length() == 0)
+	{
+		cerr << "Missing input file!" << endl;
+		return false;
+	}
+
+	fd = ::open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		cerr << "Could not open file " << fname << "!" << endl;
+		return false;
+	}
+
+	struct stat st;
+	unsigned char buf[SIZE_HEADER];
+
+	if (fstat(fd, &st) != 0 || pread(fd, buf, SIZE_HEADER, 0) != SIZE_HEADER ||
+			memcmp(buf, "\0FSFILE\0", 8) != 0)
+	{
+		cerr << "File " << fname << " is not an FSF file!" << endl;
+		close();
+		return false;
+	}
+
+	fileSize = st.st_size;
+	numBlocks = (fileSize - SIZE_HEADER) / SIZE_BLOCK;
+	listStartBlock = loadLE32(buf+8);
+	return true;
+}
+
+void Archive::close()
+{
+	if (fd >= 0)
+		::close(fd);
+
+	fd = -1;
+}
+
+bool Archive::readIndex()
+{
+	struct USAGE_BLOCK usageBlock;
+	unsigned char memblock[SIZE_BLOCK] = {0};
+	BlockView block(memblock);
+	UsageView usage(memblock);
+
+	if (fd < 0 && !open())
+		return false;
+
+	TraceScope scope(opts.trace, TRACE_INDEX);
+	deleteIndex();
+	truncated = false;
+
+	if (opts.scan)
+		return scanIndex();
+
+	if (opts.verbose)
+		cout << "First block starts at: " << to_string(listStartBlock) << endl << endl;
+
+	if (!readBlock(0, memblock))
+		return false;
+
+	if (opts.verbose)
+	{
+		cout << "thisBlock: " << to_string(block.thisBlock()) << endl;
+		cout << "prevBlock: " << to_string(block.prevBlock()) << endl;
+		cout << "nextBlock: " << to_string(block.nextBlock()) << endl;
+		cout << "bytesUsed: " << to_string(block.bytesUsed()) << endl << endl;
+	}
+
+	uint32_t nextBlock = listStartBlock;
+	vector<bool> seen(numBlocks, false);
+
+	// A damaged chain ends the index early. The entries read so far are
+	// kept, but indexTruncated() tells that some may be missing.
+	while (nextBlock > 0)
+	{
+		if (!readBlock(nextBlock, memblock))
+		{
+			truncated = true;
+			break;
+		}
+
+		// A damaged chain may point back to an earlier index block.
+		if (seen[nextBlock])
+		{
+			cerr << "Index chain has a cycle at block " << to_string(nextBlock) << "!" << endl;
+			truncated = true;
+			break;
+		}
+
+		seen[nextBlock] = true;
+
+		if (usage.thisBlock() != nextBlock)
+		{
+			size_t pos = calcBlockPos(nextBlock) + SIZE_BLOCK;
+			cerr << "No valid block position (" << to_string(pos) << " [" << toHex(pos, 8) << "])" << endl;
+			truncated = true;
+			break;
+		}
+
+		fillUsageBlock(usageBlock, usage);
+
+		if (opts.verbose)
+		{
+			cout << "thisBlock: " << to_string(usageBlock.thisBlock) << " (" << toHex(usageBlock.thisBlock, 8) << ")" << endl;
+			cout << "prevBlock: " << to_string(usageBlock.prevBlock) << " (" << toHex(usageBlock.prevBlock, 8) << ")" << endl;
+			cout << "nextBlock: " << to_string(usageBlock.nextBlock) << " (" << toHex(usageBlock.nextBlock, 8) << ")" << endl;
+			cout << "bytesUsed: " << to_string(usageBlock.bytesUsed) << " (" << toHex(usageBlock.bytesUsed, 8) << ")" << endl;
+			cout << "filePath:  " << usageBlock.filePath << endl << endl;
+			cout << "creat time:" << asctime(gmtime(&usageBlock.tmCreate));
+			cout << "modif time:" << asctime(gmtime(&usageBlock.tmModify));
+			cout << "Flags:     " << to_string(usageBlock.flags) << endl;
+			cout << "startBlock:" << to_string(usageBlock.startBlock) << endl;
+			cout << "sizeBlocks:" << to_string(usageBlock.sizeBlocks) << endl;
+			cout << "sizeBytes: " << to_string(usageBlock.sizeBytes) << " (" << toHex(usageBlock.sizeBytes, 8) << ")" << endl << endl;
+		}
+
+		nextBlock = usage.nextBlock();
+
+		// Entries not selected by the filter are dropped here. Their data
+		// chains are never read.
+		if (filter && !filter->match(string(usageBlock.filePath)))
+			continue;
+
+		appendUBlock(&usageBlock);
+	}
+
+	if (opts.verbose)
+		cout << "Index: " << entries.size() << " entries, " << arena.getUsed() << " bytes of metadata." << endl << endl;
+
+	return true;
+}
+
+/*
+ * Rebuilds the index without following any pointer on the disk. The file
+ * is split into ranges of SCAN_BLOCKS blocks which are read in parallel.
+ * Every block whose number matches its position is taken. It is an index
+ * block if it holds a plausible entry, otherwise a data block.
+ *
+ * The index blocks reachable from the start of the index come first and
+ * in their order. Index blocks not reachable because of a damaged link
+ * follow in the order of their position. The chain of every entry is
+ * checked against the table of data blocks. A broken link is repaired
+ * if exactly one data block names the block before as its previous one.
+ * Entries whose chain can't be repaired are dropped.
+ */
+bool Archive::scanIndex()
+{
+	enum : unsigned char { BLOCK_NONE, BLOCK_DATA, BLOCK_USAGE };
+
+	vector<unsigned char> kind(numBlocks, BLOCK_NONE);
+	vector<uint32_t> prevs(numBlocks, 0), nexts(numBlocks, 0);
+	vector<char> dataOk(numBlocks, 0);		// Could be a data block too
+	size_t numRanges = ((size_t)numBlocks + SCAN_BLOCKS - 1) / SCAN_BLOCKS;
+	vector<vector<unsigned char>> usages(numRanges);	// Index blocks found in every range
+	vector<char> failed(numRanges, 0);
+
+	parallelFor(numRanges, [&](size_t r)
+	{
+		uint32_t first = r * SCAN_BLOCKS;
+		uint32_t count = min((uint32_t)SCAN_BLOCKS, numBlocks - first);
+		vector<unsigned char> buf((size_t)count * SIZE_BLOCK);
+
+		if (!readBlocks(first, count, buf.data()))
+		{
+			failed[r] = 1;
+			return;
+		}
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const unsigned char *raw = buf.data() + (size_t)i * SIZE_BLOCK;
+			BlockView block(raw);
+			uint32_t b = first + i;
+
+			// Block 0 is no data block, even if it looks like one.
+			if (b == 0 || block.thisBlock() != b)
+				continue;
+
+			dataOk[b] = block.bytesUsed() <= SIZE_PAYLOAD && block.prevBlock() < numBlocks;
+
+			// A damaged link of an index block is ignored; its entry is
+			// still taken.
+			if (isUsageBlock(UsageView(raw), b, numBlocks))
+			{
+				kind[b] = BLOCK_USAGE;
+				usages[r].insert(usages[r].end(), raw, raw + SIZE_BLOCK);
+			}
+			else if (dataOk[b])
+				kind[b] = BLOCK_DATA;
+			else
+				continue;
+
+			prevs[b] = block.prevBlock() < numBlocks ? block.prevBlock() : 0;
+			nexts[b] = block.nextBlock() < numBlocks ? block.nextBlock() : 0;
+		}
+	}, 0);
+
+	if (find(failed.begin(), failed.end(), 1) != failed.end())
+		return false;
+
+	// The position of every index block in the ranges
+	unordered_map<uint32_t, const unsigned char *> found;
+
+	for (auto itr = usages.begin(); itr != usages.end(); ++itr)
+	{
+		for (size_t pos = 0; pos < itr->size(); pos += SIZE_BLOCK)
+			found[BlockView(itr->data() + pos).thisBlock()] = itr->data() + pos;
+	}
+
+	auto demote = [&](uint32_t b) { kind[b] = dataOk[b] ? BLOCK_DATA : BLOCK_NONE; };
+
+	// A short data block may look like an index block. It is a data block
+	// if it starts the chain of an entry or is linked into it in both
+	// directions. A damaged link is not followed, so a real index block is
+	// never taken for a data block.
+	for (uint32_t b = 1; b < numBlocks; ++b)
+	{
+		if (kind[b] != BLOCK_USAGE)
+			continue;
+
+		UsageView uv(found[b]);
+		uint32_t cur = uv.startBlock();
+
+		if (uv.sizeBlocks() == 0 || cur == 0 || prevs[cur] != 0)
+			continue;
+
+		if (kind[cur] == BLOCK_USAGE && cur != listStartBlock)
+			demote(cur);
+
+		for (uint32_t i = 1; i < uv.sizeBlocks(); ++i)
+		{
+			uint32_t next = nexts[cur];
+
+			if (next == 0 || prevs[next] != cur)
+				break;
+
+			if (kind[next] == BLOCK_USAGE)
+				demote(next);
+
+			cur = next;
+		}
+	}
+
+	// The links of an index block point to other index blocks. One damaged
+	// link is accepted if the other one points to an index block or if the
+	// header names the block as the first one.
+	auto isUsage = [&](uint32_t b) { return b > 0 && kind[b] == BLOCK_USAGE; };
+
+	for (bool changed = true; changed; )
+	{
+		changed = false;
+
+		for (uint32_t b = 1; b < numBlocks; ++b)
+		{
+			if (kind[b] != BLOCK_USAGE)
+				continue;
+
+			bool linked = (prevs[b] == 0 || isUsage(prevs[b])) && (nexts[b] == 0 || isUsage(nexts[b]));
+
+			if (!linked && b != listStartBlock && !isUsage(prevs[b]) && !isUsage(nexts[b]))
+			{
+				demote(b);
+				changed = true;
+			}
+		}
+	}
+
+	// The successor of a block is known if only one data block points back
+	// to it. UINT32_MAX marks more than one.
+	vector<uint32_t> succ(numBlocks, 0);
+
+	for (uint32_t b = 1; b < numBlocks; ++b)
+	{
+		if (kind[b] == BLOCK_DATA && prevs[b] > 0)
+			succ[prevs[b]] = succ[prevs[b]] ? UINT32_MAX : b;
+	}
+
+	auto validLink = [&](uint32_t from, uint32_t to)
+	{
+		return to > 0 && to < numBlocks && kind[to] == BLOCK_DATA && prevs[to] == from;
+	};
+
+	vector<uint32_t> order;
+	vector<bool> taken(numBlocks, false);
+
+	for (uint32_t b = listStartBlock; b > 0 && b < numBlocks && kind[b] == BLOCK_USAGE && !taken[b]; b = nexts[b])
+	{
+		order.push_back(b);
+		taken[b] = true;
+	}
+
+	size_t linked = order.size();
+
+	for (uint32_t b = 1; b < numBlocks; ++b)
+	{
+		if (kind[b] == BLOCK_USAGE && !taken[b])
+			order.push_back(b);
+	}
+
+	struct USAGE_BLOCK usageBlock;
+	size_t repaired = 0, dropped = 0;
+
+	for (auto itr = order.begin(); itr != order.end(); ++itr)
+	{
+		fillUsageBlock(usageBlock, UsageView(found[*itr]));
+		uint32_t cur = usageBlock.startBlock;
+		bool ok = (usageBlock.sizeBlocks == 0 || (cur > 0 && kind[cur] == BLOCK_DATA));
+		unordered_map<uint32_t, uint32_t> fixes;
+
+		for (uint32_t i = 1; ok && i < usageBlock.sizeBlocks; ++i)
+		{
+			uint32_t next = nexts[cur];
+
+			if (!validLink(cur, next))
+			{
+				next = succ[cur];
+
+				if (next == UINT32_MAX || !validLink(cur, next))
+				{
+					ok = false;
+					break;
+				}
+
+				fixes[cur] = next;
+			}
+
+			cur = next;
+		}
+
+		if (!ok)
+		{
+			cerr << "WARNING: The chain of " << usageBlock.filePath << " is damaged. The file is dropped." << endl;
+			dropped++;
+			continue;
+		}
+
+		repaired += fixes.size();
+		links.insert(fixes.begin(), fixes.end());
+
+		if (filter && !filter->match(string(usageBlock.filePath)))
+			continue;
+
+		appendUBlock(&usageBlock);
+	}
+
+	if (order.size() > linked)
+		cerr << "WARNING: " << (order.size() - linked) << " index blocks were not linked into the index and were recovered." << endl;
+
+	if (repaired > 0)
+		cerr << "WARNING: " << repaired << " links of chains were repaired." << endl;
+
+	if (opts.verbose)
+	{
+		cout << "Scanned " << numBlocks << " blocks in " << numRanges << " ranges: " << order.size() << " index blocks, "
+			 << count(kind.begin(), kind.end(), BLOCK_DATA) << " data blocks, " << dropped << " entries dropped." << endl;
+		cout << "Index: " << entries.size() << " entries, " << arena.getUsed() << " bytes of metadata." << endl << endl;
+	}
+
+	return true;
+}
+
+/*
+ * Checks whether the block \p block holds a plausible index entry. It
+ * must use exactly the bytes of an entry, both times must be set and not
+ * lie in the future, the path must be printable, the chain must start
+ * inside of the file and the data must fit into its blocks.
+ */
+bool Archive::isUsageBlock(const UsageView& uv, uint32_t block, uint32_t numBlocks)
+{
+	if (uv.bytesUsed() != layout::USAGE_LEN - layout::DATA)
+		return false;
+
+	// A day is added for a clock running behind the one of the writer.
+	time_t latest = time(nullptr) + 24 * 3600;
+
+	if (uv.tmCreate() == 0 || uv.tmModify() == 0 || uv.tmCreate() > latest || uv.tmModify() > latest)
+		return false;
+
+	string_view path = uv.filePath();
+
+	if (path.empty() || path.length() >= layout::FILE_PATH_LEN)
+		return false;
+
+	for (auto itr = path.begin(); itr != path.end(); ++itr)
+	{
+		if ((unsigned char)*itr < 0x20)
+			return false;
+	}
+
+	uint32_t start = uv.startBlock();
+	uint32_t size = uv.sizeBlocks();
+
+	if (size == 0)
+		return uv.sizeBytes() == 0;
+
+	return start != block && start < numBlocks && size < numBlocks &&
+		uv.sizeBytes() <= (uint64_t)size * SIZE_PAYLOAD;
+}
+
+/*
+ * Returns the block following \p block in its chain. This is the link
+ * stored in the block unless the scan repaired it.
+ */
+uint32_t Archive::nextLink(const BlockView& block) const
+{
+	if (!links.empty())
+	{
+		auto itr = links.find(block.thisBlock());
+
+		if (itr != links.end())
+			return itr->second;
+	}
+
+	return block.nextBlock();
+}
+
+/*
+ * Reads the block \p block into \p buf. The buffer must be at least
+ * SIZE_BLOCK bytes long.
+ */
+bool Archive::readBlock(uint32_t block, unsigned char *buf)
+{
+	return readBlocks(block, 1, buf);
+}
+
+/*
+ * Reads \p count consecutive blocks starting with \p first with one
+ * pread(). The buffer must be at least \p count * SIZE_BLOCK bytes long.
+ */
+bool Archive::readBlocks(uint32_t first, uint32_t count, unsigned char *buf)
+{
+	if (first >= numBlocks || count > numBlocks - first)
+	{
+		if (count == 1)
+			cerr << "Block " << to_string(first) << " is outside of file " << fname << "!" << endl;
+		else
+			cerr << "Blocks " << to_string(first) << " to " << to_string(first + count - 1) << " are outside of file " << fname << "!" << endl;
+		return false;
+	}
+
+	size_t pos = calcBlockPos(first);
+	size_t size = (size_t)count * SIZE_BLOCK;
+	size_t len = 0;
+
+	while (len < size)
+	{
+		ssize_t r = pread(fd, buf + len, size - len, pos + len);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r <= 0)
+		{
+			cerr << "Error reading block " << to_string(first + len / SIZE_BLOCK) << " from file " << fname << "!" << endl;
+			return false;
+		}
+
+		len += r;
+	}
+
+	return true;
+}
+
+/*
+ * Reads the payload of all blocks of the entry \p ub and appends it to
+ * \p data. The chain is followed as it is, with the links repaired by a
+ * scan; use Verify to check it.
+ */
+bool Archive::readChain(const struct USAGE_BLOCK *ub, string& data)
+{
+	unsigned char memblock[SIZE_BLOCK] = {0};
+	BlockView block(memblock);
+	uint32_t nextBlock = ub->startBlock;
+	TraceScope scope(opts.trace, TRACE_READ, ub->utf8Path);
+
+	// The sizes are not trusted. A chain can't have more blocks than the
+	// file.
+	if (ub->sizeBlocks > numBlocks)
+	{
+		cerr << "The chain of " << ub->filePath << " has more blocks than the file!" << endl;
+		return false;
+	}
+
+	data.reserve(data.length() + min((size_t)ub->sizeBytes, (size_t)ub->sizeBlocks * SIZE_PAYLOAD));
+
+	for (uint32_t i = 0; i < ub->sizeBlocks; i++)
+	{
+		if (!readBlock(nextBlock, memblock))
+			return false;
+
+		ByteSpan payload = block.payload();
+		data.append(payload.chars(), payload.size);
+		nextBlock = nextLink(block);
+	}
+
+	return true;
+}
+
+/*
+ * Returns the index entry with the path \p name (as stored or in UTF-8)
+ * or NULL if there is no
+ * such entry.
+ */
+const struct USAGE_BLOCK *Archive::findEntry(string_view name)
+{
+	for (auto itr = entries.begin(); itr != entries.end(); ++itr)
+	{
+		if (name == (*itr)->ublock->filePath || name == (*itr)->ublock->utf8Path)
+			return (*itr)->ublock;
+	}
+
+	return nullptr;
+}
+
+/*
+ * Detects how an entry is stored by looking at the first bytes of its
+ * payload. gzip files start with the magic bytes 0x1f 0x8b. XML files
+ * not starting with "<?" are encrypted.
+ */
+CODING Archive::detectCoding(string_view name, const unsigned char *data, size_t len)
+{
+	if (len < 2)
+		return CODING_PLAIN;
+
+	if (data[0] == 0x1f && data[1] == 0x8b)
+		return CODING_GZIP;
+
+	if ((name.find(".xma") != string::npos || name.find(".xml") != string::npos) &&
+			data[0] != '<' && data[1] != '?')
+		return CODING_AES;
+
+	return CODING_PLAIN;
+}
+
+/*
+ * Decodes the payload \p in of an entry stored with \p coding into \p out.
+ * Plain entries are copied. If \p quiet is TRUE, no error messages are
+ * printed.
+ */
+bool Archive::decode(CODING coding, const string& in, string& out, bool quiet) const
+{
+	const unsigned char *buf = reinterpret_cast<const unsigned char *>(in.data());
+
+	if (coding == CODING_GZIP)
+	{
+		Expand exp;
+		exp.setQuiet(quiet);
+		out.clear();
+		TraceScope scope(opts.trace, TRACE_INFLATE);
+		return exp.unzip(buf, in.length(), out) == 0;
+	}
+	else if (coding == CODING_AES)
+	{
+		Scramble scr;
+		scr.setQuiet(quiet);
+		scr.setVerbose(opts.verbose);
+
+		{
+			TraceScope scope(opts.trace, TRACE_AES_INIT);
+
+			if (!scr.aesInit(opts.password, opts.salt))
+				return false;
+		}
+
+		TraceScope scope(opts.trace, TRACE_DECRYPT);
+
+		if (!scr.aesDecodeBuffer(buf, in.length()))
+			return false;
+
+		out.swap(scr.getDecrypted());
+		return true;
+	}
+
+	out = in;
+	return true;
+}
+
+/*
+ * The opposite of decode(): Compresses or encrypts \p in into \p out.
+ */
+bool Archive::encode(CODING coding, const string& in, string& out) const
+{
+	const unsigned char *buf = reinterpret_cast<const unsigned char *>(in.data());
+
+	if (coding == CODING_GZIP)
+	{
+		Expand exp;
+		out.clear();
+		return exp.zip(buf, in.length(), out) == 0;
+	}
+	else if (coding == CODING_AES)
+	{
+		Scramble scr;
+
+		if (!scr.aesInit(opts.password, opts.salt, true) || !scr.aesEncodeBuffer(buf, in.length()))
+			return false;
+
+		out.swap(scr.getDecrypted());
+		return true;
+	}
+
+	out = in;
+	return true;
+}
+
+/*
+ * Copies an index entry into \p ub. The path still points into the buffer
+ * of \p uv; appendUBlock() copies it into the arena.
+ */
+void Archive::fillUsageBlock (struct USAGE_BLOCK &ub, const UsageView& uv)
+{
+	ub.thisBlock = uv.thisBlock();
+	ub.prevBlock = uv.prevBlock();
+	ub.nextBlock = uv.nextBlock();
+	ub.bytesUsed = uv.bytesUsed();
+	ub.filePath = uv.filePath();
+	ub.utf8Path = std::string_view();
+	ub.tmCreate = uv.tmCreate();
+	ub.tmModify = uv.tmModify();
+	ub.flags = uv.flags();
+	ub.startBlock = uv.startBlock();
+	ub.sizeBlocks = uv.sizeBlocks();
+	ub.sizeBytes = uv.sizeBytes();
+}
+
+/*
+ * Writes the index entry \p ub into the raw block \p buf. The buffer must
+ * be at least SIZE_BLOCK bytes long.
+ */
+void Archive::storeUsageBlock(unsigned char *buf, const struct USAGE_BLOCK& ub)
+{
+	memset(buf, 0, SIZE_BLOCK);
+	storeLE32(buf + layout::THIS_BLOCK, ub.thisBlock);
+	storeLE32(buf + layout::PREV_BLOCK, ub.prevBlock);
+	storeLE32(buf + layout::NEXT_BLOCK, ub.nextBlock);
+	storeLE16(buf + layout::BYTES_USED, ub.bytesUsed);
+	memcpy(buf + layout::FILE_PATH, ub.filePath.data(), min(ub.filePath.length(), layout::FILE_PATH_LEN));
+	storeLE32(buf + layout::TM_CREATE, (uint32_t)ub.tmCreate);
+	storeLE32(buf + layout::TM_MODIFY, (uint32_t)ub.tmModify);
+	storeLE32(buf + layout::FLAGS, ub.flags);
+	storeLE32(buf + layout::START_BLOCK, ub.startBlock);
+	storeLE32(buf + layout::SIZE_BLOCKS, ub.sizeBlocks);
+	storeLE32(buf + layout::SIZE_BYTES, ub.sizeBytes);
+}
+
+struct INDEX *Archive::appendUBlock (const struct USAGE_BLOCK *ub)
+{
+	struct USAGE_BLOCK *nb;
+	struct INDEX *act;
+
+	try
+	{
+		nb = arena.create<struct USAGE_BLOCK>();
+		*nb = *ub;
+		nb->filePath = arena.storeString(ub->filePath);
+
+		// A path of ASCII characters is the same in UTF-8 and is stored
+		// only once.
+		if (all_of(nb->filePath.begin(), nb->filePath.end(), [](char c) { return (unsigned char)c < 0x80; }))
+			nb->utf8Path = nb->filePath;
+		else
+			nb->utf8Path = arena.storeString(cp1250ToUTF8(nb->filePath));
+
+		act = arena.create<struct INDEX>();
+		act->prev = last;
+		act->next = nullptr;
+		act->ublock = nb;
+
+		if (idx == nullptr)
+			idx = act;
+		else
+			last->next = act;
+
+		last = act;
+		entries.push_back(act);
+	}
+	catch (exception& e)
+	{
+		cerr << "Archive::appendUBlock: " << e.what() << endl;
+		exit(3);
+	}
+
+	return act;
+}
+
+void Archive::deleteIndex()
+{
+	// All entries and paths are in the arena.
+	arena.clear();
+	idx = last = nullptr;
+	entries.clear();
+	links.clear();
+}
+
+/*
+ * Converts a path stored in CP1250 into UTF-8.
+ */
+string Archive::cp1250ToUTF8(string_view str)
+{
+	string out;
+
+	for (size_t j = 0; j < str.length(); j++)
+	{
+		int i = -1;
+		unsigned char ch = str[j];
+		short utf = -1;
+
+		if (ch < 0x80)
+		{
+			do
+			{
+				i++;
+
+				if (__cht[i].ch == ch)
+				{
+					utf = __cht[i].byte;
+					break;
+				}
+			}
+			while (__cht[i].ch != 0xff);
+
+			if (utf < 0)
+				utf = ch;
+		}
+		else
+			utf = ch;
+
+		if (utf > 0x00ff)
+		{
+			out.push_back((utf >> 8) & 0x00ff);
+			out.push_back(utf & 0x00ff);
+		}
+		else if (ch > 0x7f)
+		{
+			out.push_back(0xc0 | ch >> 6);
+			out.push_back(0x80 | (ch & 0x3f));
+		}
+		else
+			out.push_back(ch);
+	}
+
+	return out;
+}
+
+size_t Archive::calcBlockPos (uint32_t block)
+{
+    if (block == 0)
+        return SIZE_HEADER;
+
+    size_t first = SIZE_HEADER;
+    return (first + (SIZE_BLOCK * block));
+}
+
+string Archive::toHex(int num, int width)
+{
+	string ret;
+	std::stringstream s;
+	s << std::setfill ('0') << std::setw(width) << std::hex << num;
+	ret = s.str();
+	return ret;
+}
+
+void Archive::dump (const unsigned char *buf, size_t size)
+{
+	short pos = 0;
+	char byte = 0;
+	bool nl = true;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		if (nl)
+			cout << toHex(pos, 4) << ": ";
+
+		nl = false;
+		byte = *(buf+i);
+		cout << toHex(byte&0x000000ff, 2) << " ";
+
+		if (i > 0 && ((i+1) % 8) == 0)
+		{
+			pos = i + 1;
+			nl = true;
+			cout << endl;
+		}
+	}
+
+	cout << endl << endl;
+}
+
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2019, 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+#include <string>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+#include <string_view>
+#include <unordered_map>
+
+#include "arena.h"
+#include "blockview.h"
+#include "filter.h"
+#include "options.h"
+
+namespace reader
+{
+	struct HEADER		// This is the first entry in the file.
+	{
+		unsigned char abyFileID[8];		// 0 - 7
+		uint32_t listStartBlock;		// 8 - 11
+	};
+
+	struct USAGE_BLOCK	// This is an index entry
+	{
+		uint32_t thisBlock;				// 0 - 3
+		uint32_t prevBlock;				// 4 - 7
+		uint32_t nextBlock;				// 8 - 11
+		uint16_t bytesUsed;				// 12 - 13
+		std::string_view filePath;		// 14 - 273, as stored (CP1250)
+		std::string_view utf8Path;		// filePath converted to UTF-8
+		time_t tmCreate;				// 274 - 277
+		time_t tmModify;				// 278 - 281
+		uint32_t flags;					// 282 - 285
+		uint32_t startBlock;			// 286 - 289
+		uint32_t sizeBlocks;			// 290 - 293
+		uint32_t sizeBytes;				// 294 - 297
+	};
+
+	struct INDEX
+	{
+		struct USAGE_BLOCK *ublock{nullptr};
+		struct INDEX *prev{nullptr};
+		struct INDEX *next{nullptr};
+	};
+
+	typedef enum
+	{
+		CODING_PLAIN,		// Stored as is
+		CODING_GZIP,		// Compressed with gzip (TP4)
+		CODING_AES			// Encrypted with AES-128-CBC (TP5)
+	}CODING;
+
+	#define SIZE_HEADER			12
+	#define SIZE_BLOCK			526
+	#define SIZE_USAGE_BLOCK	298
+	#define SIZE_FILE_HEAD		14
+	#define SIZE_PAYLOAD		512
+	#define SCAN_BLOCKS			2048	// Blocks read at once by one thread of the scan
+
+	static_assert(SIZE_BLOCK == layout::BLOCK_LEN && SIZE_USAGE_BLOCK == layout::USAGE_LEN, "Block sizes don't match the layout");
+	static_assert(SIZE_FILE_HEAD == layout::DATA && SIZE_PAYLOAD == layout::PAYLOAD_LEN, "Block sizes don't match the layout");
+
+	/**
+	 * An open FSF file. The class reads the header and the index and gives
+	 * access to the blocks. All reads are done with pread(). Therefore
+	 * readBlock() and readChain() may be called from several threads at the
+	 * same time once the index was read.
+	 *
+	 * The index entries and their paths are allocated in an arena. They
+	 * stay valid until the index is read again or the archive is
+	 * destroyed; then they are freed at once.
+	 *
+	 * With the option "scan" the index is not read by following the chain
+	 * of index blocks. Instead all blocks are read in parallel and the
+	 * index and the chains are rebuilt from the blocks whose number
+	 * matches their position (see scanIndex()). Links repaired by the scan
+	 * are returned by nextLink().
+	 *
+	 * Without the scan a damaged chain of index blocks ends the index. The
+	 * entries before it are kept and indexTruncated() returns TRUE.
+	 */
+	class Archive
+	{
+		std::string fname;
+		OPTIONS opts;
+		int fd{-1};
+		size_t fileSize{0};
+		uint32_t numBlocks{0};
+		uint32_t listStartBlock{0};
+		struct INDEX *idx{nullptr};
+		struct INDEX *last{nullptr};
+		std::vector<struct INDEX *> entries;
+		const EntryFilter *filter{nullptr};
+		Arena arena;
+		std::unordered_map<uint32_t, uint32_t> links;	// Next blocks repaired by the scan
+		bool truncated{false};							// The chain of index blocks ended at a damaged block
+
+		public:
+			explicit Archive(const std::string& fn, const OPTIONS& o = OPTIONS())
+				: fname{fn},
+				  opts{o}
+			{}
+
+			~Archive();
+
+			bool open();
+			void close();
+			void setFilter(const EntryFilter *f) { filter = f; }
+			bool readIndex();
+			bool readBlock(uint32_t block, unsigned char *buf);
+			bool readBlocks(uint32_t first, uint32_t count, unsigned char *buf);
+			bool readChain(const struct USAGE_BLOCK *ub, std::string& data);
+			const struct USAGE_BLOCK *findEntry(std::string_view name);
+			uint32_t nextLink(const BlockView& block) const;
+
+			struct INDEX *getIndex() { return idx; }
+			const std::vector<struct INDEX *>& getEntries() { return entries; }
+			const std::string& getFileName() { return fname; }
+			uint32_t getNumBlocks() { return numBlocks; }
+			uint32_t getListStartBlock() { return listStartBlock; }
+			size_t getFileSize() { return fileSize; }
+			bool indexTruncated() const { return truncated; }
+			const Arena& getArena() const { return arena; }
+			const OPTIONS& getOptions() const { return opts; }
+
+			bool decode(CODING coding, const std::string& in, std::string& out, bool quiet=false) const;
+			bool encode(CODING coding, const std::string& in, std::string& out) const;
+
+			static CODING detectCoding(std::string_view name, const unsigned char *data, size_t len);
+			static size_t calcBlockPos(uint32_t block);
+			static void fillUsageBlock(struct USAGE_BLOCK& ub, const UsageView& uv);
+			static void storeUsageBlock(unsigned char *buf, const struct USAGE_BLOCK& ub);
+			static std::string cp1250ToUTF8(std::string_view str);
+			static std::string toHex(int num, int width);
+			static void dump(const unsigned char *buf, size_t size);
+
+		private:
+			bool scanIndex();
+			static bool isUsageBlock(const UsageView& uv, uint32_t block, uint32_t numBlocks);
+			struct INDEX *appendUBlock(const struct USAGE_BLOCK *ub);
+			void deleteIndex();
+	};
+}
+
+#endif
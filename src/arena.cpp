@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <cstring>
+#include <cstdint>
+
+#include "arena.h"
+
+using namespace reader;
+using namespace std;
+
+/*
+ * Returns \p size bytes aligned to \p align, which must be a power of 2.
+ * Requests bigger than a chunk get a chunk of their own.
+ */
+void *Arena::allocate(size_t size, size_t align)
+{
+	size_t pad = (align - (reinterpret_cast<uintptr_t>(ptr) & (align - 1))) & (align - 1);
+
+	if (!ptr || pad + size > left)
+	{
+		size_t len = size + align > ARENA_CHUNK ? size + align : ARENA_CHUNK;
+		chunks.emplace_back(new char[len]);
+		ptr = chunks.back().get();
+		left = len;
+		reserved += len;
+		pad = (align - (reinterpret_cast<uintptr_t>(ptr) & (align - 1))) & (align - 1);
+	}
+
+	char *p = ptr + pad;
+	ptr = p + size;
+	left -= pad + size;
+	used += size;
+	return p;
+}
+
+/*
+ * Copies \p str into the arena. The copy is terminated by a 0 byte, so
+ * data() of the returned view may be used as a C string.
+ */
+string_view Arena::storeString(string_view str)
+{
+	char *p = static_cast<char *>(allocate(str.length() + 1, 1));
+	memcpy(p, str.data(), str.length());
+	p[str.length()] = 0;
+	return string_view(p, str.length());
+}
+
+void Arena::clear()
+{
+	chunks.clear();
+	ptr = nullptr;
+	left = used = reserved = 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+
+#define ARENA_CHUNK		(64 * 1024)		// Size of one piece of memory
+
+namespace reader
+{
+	/**
+	 * A monotonic allocator for the metadata of an archive. Memory is taken
+	 * from big chunks and is never given back one by one. clear() frees
+	 * everything at once. Only objects without a destructor may be created
+	 * in the arena. The class is not thread safe.
+	 */
+	class Arena
+	{
+		std::vector<std::unique_ptr<char[]>> chunks;
+		char *ptr{nullptr};
+		size_t left{0};
+		size_t used{0};
+		size_t reserved{0};
+
+		public:
+			Arena() {}
+			Arena(const Arena&) = delete;
+			Arena& operator=(const Arena&) = delete;
+
+			void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+			std::string_view storeString(std::string_view str);
+			void clear();
+
+			template<typename T>
+			T *create()
+			{
+				static_assert(std::is_trivially_destructible<T>::value, "Objects in an arena are never destroyed");
+				return new (allocate(sizeof(T), alignof(T))) T();
+			}
+
+			size_t getUsed() const { return used; }
+			size_t getReserved() const { return reserved; }
+	};
+}
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __BLOCKVIEW_H__
+#define __BLOCKVIEW_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace reader
+{
+	/*
+	 * Layout of a block in an FSF file. All numbers are stored in little
+	 * endian byte order and are not aligned.
+	 */
+	namespace layout
+	{
+		constexpr size_t THIS_BLOCK = 0;		// uint32_t
+		constexpr size_t PREV_BLOCK = 4;		// uint32_t
+		constexpr size_t NEXT_BLOCK = 8;		// uint32_t
+		constexpr size_t BYTES_USED = 12;		// uint16_t
+		constexpr size_t DATA = 14;				// Payload of a data block
+		constexpr size_t PAYLOAD_LEN = 512;
+		constexpr size_t BLOCK_LEN = DATA + PAYLOAD_LEN;
+
+		// Usage block (index entry)
+		constexpr size_t FILE_PATH = 14;		// Zero terminated path
+		constexpr size_t FILE_PATH_LEN = 260;
+		constexpr size_t TM_CREATE = 274;		// uint32_t
+		constexpr size_t TM_MODIFY = 278;		// uint32_t
+		constexpr size_t FLAGS = 282;			// uint32_t
+		constexpr size_t START_BLOCK = 286;		// uint32_t
+		constexpr size_t SIZE_BLOCKS = 290;		// uint32_t
+		constexpr size_t SIZE_BYTES = 294;		// uint32_t
+		constexpr size_t USAGE_LEN = 298;
+
+		static_assert(PREV_BLOCK == THIS_BLOCK + 4 && NEXT_BLOCK == PREV_BLOCK + 4 && BYTES_USED == NEXT_BLOCK + 4, "Block header fields overlap");
+		static_assert(DATA == BYTES_USED + 2 && BLOCK_LEN == 526, "Wrong size of a block");
+		static_assert(FILE_PATH == DATA && TM_CREATE == FILE_PATH + FILE_PATH_LEN, "Wrong position of the path");
+		static_assert(TM_MODIFY == TM_CREATE + 4 && FLAGS == TM_MODIFY + 4 && START_BLOCK == FLAGS + 4, "Usage block fields overlap");
+		static_assert(SIZE_BLOCKS == START_BLOCK + 4 && SIZE_BYTES == SIZE_BLOCKS + 4 && USAGE_LEN == SIZE_BYTES + 4, "Usage block fields overlap");
+		static_assert(USAGE_LEN <= BLOCK_LEN, "A usage block must fit into a block");
+	}
+
+	inline uint32_t loadLE32(const unsigned char *p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));		// Unaligned load
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		v = __builtin_bswap32(v);
+#endif
+		return v;
+	}
+
+	inline uint16_t loadLE16(const unsigned char *p)
+	{
+		uint16_t v;
+		memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		v = __builtin_bswap16(v);
+#endif
+		return v;
+	}
+
+	inline void storeLE32(unsigned char *p, uint32_t v)
+	{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		v = __builtin_bswap32(v);
+#endif
+		memcpy(p, &v, sizeof(v));
+	}
+
+	inline void storeLE16(unsigned char *p, uint16_t v)
+	{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		v = __builtin_bswap16(v);
+#endif
+		memcpy(p, &v, sizeof(v));
+	}
+
+	/**
+	 * A read only range of bytes. It does not own the memory.
+	 */
+	struct ByteSpan
+	{
+		const unsigned char *data{nullptr};
+		size_t size{0};
+
+		const unsigned char *begin() const { return data; }
+		const unsigned char *end() const { return data + size; }
+		const char *chars() const { return reinterpret_cast<const char *>(data); }
+		bool empty() const { return size == 0; }
+	};
+
+	/**
+	 * A view on a raw block of SIZE_BLOCK bytes. The fields are decoded
+	 * when they are accessed. Nothing is copied.
+	 */
+	class BlockView
+	{
+		protected:
+			const unsigned char *buf;
+
+		public:
+			explicit BlockView(const unsigned char *b)
+				: buf{b}
+			{}
+
+			uint32_t thisBlock() const { return loadLE32(buf + layout::THIS_BLOCK); }
+			uint32_t prevBlock() const { return loadLE32(buf + layout::PREV_BLOCK); }
+			uint32_t nextBlock() const { return loadLE32(buf + layout::NEXT_BLOCK); }
+			uint16_t bytesUsed() const { return loadLE16(buf + layout::BYTES_USED); }
+
+			// The used part of the payload. A damaged bytesUsed is cut to the
+			// size of the payload.
+			ByteSpan payload() const
+			{
+				uint16_t used = bytesUsed();
+				return ByteSpan{buf + layout::DATA, used < layout::PAYLOAD_LEN ? used : layout::PAYLOAD_LEN};
+			}
+
+			ByteSpan rawPayload() const { return ByteSpan{buf + layout::DATA, layout::PAYLOAD_LEN}; }
+			const unsigned char *raw() const { return buf; }
+	};
+
+	/**
+	 * A view on a usage block (index entry).
+	 */
+	class UsageView : public BlockView
+	{
+		public:
+			explicit UsageView(const unsigned char *b)
+				: BlockView(b)
+			{}
+
+			std::string_view filePath() const
+			{
+				const char *p = reinterpret_cast<const char *>(buf + layout::FILE_PATH);
+				return std::string_view(p, strnlen(p, layout::FILE_PATH_LEN));
+			}
+
+			uint32_t tmCreate() const { return loadLE32(buf + layout::TM_CREATE); }
+			uint32_t tmModify() const { return loadLE32(buf + layout::TM_MODIFY); }
+			uint32_t flags() const { return loadLE32(buf + layout::FLAGS); }
+			uint32_t startBlock() const { return loadLE32(buf + layout::START_BLOCK); }
+			uint32_t sizeBlocks() const { return loadLE32(buf + layout::SIZE_BLOCKS); }
+			uint32_t sizeBytes() const { return loadLE32(buf + layout::SIZE_BYTES); }
+	};
+}
+
+#endif
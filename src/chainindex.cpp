@@ -0,0 +1,544 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include "chainindex.h"
+#include "expand.h"
+
+#define CHAIN_INDEX_ID	"FSFCHIX1"
+#define READ_RUN		64			// Maximum number of blocks read with one pread()
+
+using namespace reader;
+using namespace std;
+
+static void put32(string& buf, uint32_t v)
+{
+	unsigned char b[4];
+	storeLE32(b, v);
+	buf.append(reinterpret_cast<char *>(b), sizeof(b));
+}
+
+static void put64(string& buf, uint64_t v)
+{
+	put32(buf, (uint32_t)v);
+	put32(buf, (uint32_t)(v >> 32));
+}
+
+static bool get32(const string& buf, size_t& pos, uint32_t& v)
+{
+	if (pos + 4 > buf.length())
+		return false;
+
+	v = loadLE32(reinterpret_cast<const unsigned char *>(buf.data() + pos));
+	pos += 4;
+	return true;
+}
+
+static bool get64(const string& buf, size_t& pos, uint64_t& v)
+{
+	uint32_t low, high;
+
+	if (!get32(buf, pos, low) || !get32(buf, pos, high))
+		return false;
+
+	v = ((uint64_t)high << 32) | low;
+	return true;
+}
+
+/*
+ * Follows the chain of the entry and fills the block table. gzip entries
+ * are inflated once to set the checkpoints.
+ */
+bool ChainIndex::build()
+{
+	unsigned char memblock[SIZE_BLOCK] = {0};
+	BlockView block(memblock);
+	string name(ub->filePath);
+	uint32_t nextBlock = ub->startBlock;
+	bool full = true;
+
+	blocks.clear();
+	offsets.clear();
+	checkpoints.clear();
+	decoded.clear();
+	storedSize = 0;
+	coding = CODING_PLAIN;
+	blocks.reserve(ub->sizeBlocks);
+	offsets.reserve(ub->sizeBlocks);
+
+	for (uint32_t i = 0; i < ub->sizeBlocks; i++)
+	{
+		if (!archive.readBlock(nextBlock, memblock))
+			return false;
+
+		if (block.thisBlock() != nextBlock)
+		{
+			cerr << "Block " << nextBlock << " of entry " << name << " is damaged!" << endl;
+			return false;
+		}
+
+		ByteSpan payload = block.payload();
+
+		if (i == 0)
+			coding = Archive::detectCoding(name, block.rawPayload().data, SIZE_PAYLOAD);
+
+		if (i + 1 < ub->sizeBlocks && payload.size != SIZE_PAYLOAD)
+			full = false;
+
+		blocks.push_back(nextBlock);
+		offsets.push_back((uint32_t)storedSize);
+		storedSize += payload.size;
+		nextBlock = archive.nextLink(block);
+	}
+
+	// The offset of a block is calculated if all blocks are full.
+	if (full)
+		vector<uint32_t>().swap(offsets);
+
+	size = storedSize;
+
+	if (coding == CODING_GZIP)
+		return setCheckpoints();
+	else if (coding == CODING_AES)
+		return decodeAll();
+
+	return true;
+}
+
+/*
+ * Loads a table saved with save(). Returns FALSE if the file doesn't
+ * exist or if it doesn't belong to the entry. Then build() must be
+ * called.
+ */
+bool ChainIndex::load(const string& file)
+{
+	ifstream in(file, ios::in | ios::binary);
+
+	if (!in.is_open())
+		return false;
+
+	stringstream ss;
+	ss << in.rdbuf();
+	string buf = ss.str();
+	size_t pos = 8;
+	uint32_t startBlock, sizeBlocks, sizeBytes, tmModify, cod, numBlocks, numOffsets, numCheckpoints;
+	bool valid = buf.compare(0, 8, CHAIN_INDEX_ID) == 0 &&
+		get32(buf, pos, startBlock) && get32(buf, pos, sizeBlocks) && get32(buf, pos, sizeBytes) &&
+		get32(buf, pos, tmModify) && get32(buf, pos, cod) && get32(buf, pos, numBlocks) && get32(buf, pos, numOffsets) &&
+		startBlock == ub->startBlock && sizeBlocks == ub->sizeBlocks && sizeBytes == ub->sizeBytes &&
+		tmModify == (uint32_t)ub->tmModify && cod <= CODING_AES && numBlocks == sizeBlocks &&
+		(numOffsets == 0 || numOffsets == numBlocks) && pos + (size_t)(numBlocks + numOffsets) * 4 <= buf.length();
+
+	if (valid)
+	{
+		coding = (CODING)cod;
+		blocks.resize(numBlocks);
+		offsets.resize(numOffsets);
+
+		for (uint32_t i = 0; i < numBlocks; ++i)
+			get32(buf, pos, blocks[i]);
+
+		for (uint32_t i = 0; i < numOffsets; ++i)
+			get32(buf, pos, offsets[i]);
+
+		valid = get64(buf, pos, storedSize) && get64(buf, pos, size) && get32(buf, pos, numCheckpoints);
+		checkpoints.clear();
+
+		for (uint32_t i = 0; valid && i < numCheckpoints; ++i)
+		{
+			CHECKPOINT cp;
+			uint32_t bits, windowLen;
+			valid = get64(buf, pos, cp.out) && get64(buf, pos, cp.in) && get32(buf, pos, bits) && get32(buf, pos, windowLen) &&
+				bits < 8 && windowLen <= WINDOW_SIZE && pos + windowLen <= buf.length() && cp.in <= storedSize;
+
+			if (valid)
+			{
+				cp.bits = bits;
+				cp.window.assign(buf, pos, windowLen);
+				pos += windowLen;
+				checkpoints.push_back(std::move(cp));
+			}
+		}
+
+		if (coding == CODING_GZIP && checkpoints.empty())
+			valid = false;
+	}
+
+	if (!valid)
+	{
+		cerr << "Chain index " << file << " is damaged or belongs to another entry!" << endl;
+		blocks.clear();
+		offsets.clear();
+		checkpoints.clear();
+		return false;
+	}
+
+	if (coding == CODING_AES)
+		return decodeAll();
+
+	return true;
+}
+
+/*
+ * Saves the table to \p file. The decoded data of AES entries is not
+ * saved.
+ */
+bool ChainIndex::save(const string& file)
+{
+	string buf(CHAIN_INDEX_ID);
+
+	put32(buf, ub->startBlock);
+	put32(buf, ub->sizeBlocks);
+	put32(buf, ub->sizeBytes);
+	put32(buf, (uint32_t)ub->tmModify);
+	put32(buf, coding);
+	put32(buf, (uint32_t)blocks.size());
+	put32(buf, (uint32_t)offsets.size());
+
+	for (auto itr = blocks.begin(); itr != blocks.end(); ++itr)
+		put32(buf, *itr);
+
+	for (auto itr = offsets.begin(); itr != offsets.end(); ++itr)
+		put32(buf, *itr);
+
+	put64(buf, storedSize);
+	put64(buf, size);
+	put32(buf, (uint32_t)checkpoints.size());
+
+	for (auto itr = checkpoints.begin(); itr != checkpoints.end(); ++itr)
+	{
+		put64(buf, itr->out);
+		put64(buf, itr->in);
+		put32(buf, itr->bits);
+		put32(buf, (uint32_t)itr->window.length());
+		buf.append(itr->window);
+	}
+
+	ofstream out(file, ios::out | ios::binary | ios::trunc);
+
+	if (!out.is_open() || !out.write(buf.data(), buf.length()))
+	{
+		cerr << "Could not write chain index " << file << "!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Reads \p len bytes of the decoded data starting at \p offset into
+ * \p out. Less bytes are returned at the end of the entry.
+ */
+bool ChainIndex::read(uint64_t offset, size_t len, string& out)
+{
+	if (coding == CODING_GZIP)
+		return readGzip(offset, len, out);
+
+	if (coding == CODING_AES)
+	{
+		out.clear();
+
+		if (offset < size)
+			out.assign(decoded, offset, len);
+
+		return true;
+	}
+
+	return readStored(offset, len, out);
+}
+
+/*
+ * Returns the index of the block containing the stored byte \p offset.
+ */
+size_t ChainIndex::findBlock(uint64_t offset)
+{
+	if (offsets.empty())
+		return offset / SIZE_PAYLOAD;
+
+	return upper_bound(offsets.begin(), offsets.end(), offset) - offsets.begin() - 1;
+}
+
+/*
+ * Reads the stored data of the entry as it is in the file. Only the
+ * blocks containing the range are read. Consecutive blocks are read with
+ * one pread().
+ */
+bool ChainIndex::readStored(uint64_t offset, size_t len, string& out)
+{
+	out.clear();
+
+	if (offset >= storedSize)
+		return true;
+
+	if (len > storedSize - offset)
+		len = storedSize - offset;
+
+	vector<unsigned char> buf;
+	size_t i = findBlock(offset);
+	size_t pos = offset - (offsets.empty() ? (uint64_t)i * SIZE_PAYLOAD : offsets[i]);
+
+	out.reserve(len);
+
+	while (out.length() < len && i < blocks.size())
+	{
+		size_t want = (len - out.length() + pos + SIZE_PAYLOAD - 1) / SIZE_PAYLOAD;
+		uint32_t count = 1;
+
+		while (count < want && count < READ_RUN && i + count < blocks.size() && blocks[i + count] == blocks[i] + count)
+			count++;
+
+		buf.resize((size_t)count * SIZE_BLOCK);
+
+		if (!archive.readBlocks(blocks[i], count, buf.data()))
+			return false;
+
+		for (uint32_t k = 0; k < count && out.length() < len; ++k)
+		{
+			ByteSpan payload = BlockView(buf.data() + (size_t)k * SIZE_BLOCK).payload();
+
+			if (pos < payload.size)
+				out.append(payload.chars() + pos, min(payload.size - pos, len - out.length()));
+
+			pos = 0;
+		}
+
+		i += count;
+	}
+
+	if (out.length() < len)
+	{
+		cerr << "Entry " << ub->filePath << " is shorter than its chain index!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Inflates the entry once. At the end of a deflate block a checkpoint is
+ * set, if at least CHECKPOINT_SPAN bytes were decoded since the last one.
+ * The first checkpoint is the start of the deflate data.
+ */
+bool ChainIndex::setCheckpoints()
+{
+	unsigned char window[WINDOW_SIZE];
+	string input;
+	z_stream strm;
+
+	if (!readStored(0, CHUNK, input))
+		return false;
+
+	size_t header = Expand::skipHeader(reinterpret_cast<const unsigned char *>(input.data()), input.length());
+
+	if (!header)
+	{
+		cerr << "Entry " << ub->filePath << " has no valid gzip header!" << endl;
+		return false;
+	}
+
+	strm.zalloc = Z_NULL;
+	strm.zfree = Z_NULL;
+	strm.opaque = Z_NULL;
+	strm.avail_in = 0;
+	strm.next_in = Z_NULL;
+
+	if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+		return false;
+
+	CHECKPOINT first;
+	first.in = header;
+	checkpoints.push_back(first);
+
+	uint64_t in = header;
+	uint64_t last = 0;
+	int ret = Z_OK;
+	strm.avail_out = 0;
+
+	do
+	{
+		if (strm.avail_in == 0)
+		{
+			if (!readStored(in, CHUNK, input) || input.empty())
+			{
+				ret = Z_DATA_ERROR;
+				break;
+			}
+
+			in += input.length();
+			strm.next_in = reinterpret_cast<unsigned char *>(&input[0]);
+			strm.avail_in = input.length();
+		}
+
+		// The output goes round in the window, so that it always holds
+		// the last WINDOW_SIZE bytes.
+		if (strm.avail_out == 0)
+		{
+			strm.next_out = window;
+			strm.avail_out = WINDOW_SIZE;
+		}
+
+		ret = inflate(&strm, Z_BLOCK);
+
+		if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+			break;
+
+		// Bit 7 of data_type marks the end of a deflate block, bit 6 the
+		// last block of the stream.
+		if ((strm.data_type & 128) && !(strm.data_type & 64) && strm.total_out - last >= CHECKPOINT_SPAN)
+		{
+			CHECKPOINT cp;
+			size_t left = strm.avail_out;
+
+			cp.in = header + strm.total_in;
+			cp.out = strm.total_out;
+			cp.bits = strm.data_type & 7;
+			cp.window.assign(reinterpret_cast<char *>(window) + WINDOW_SIZE - left, left);
+			cp.window.append(reinterpret_cast<char *>(window), WINDOW_SIZE - left);
+			checkpoints.push_back(std::move(cp));
+			last = strm.total_out;
+		}
+	}
+	while (ret != Z_STREAM_END);
+
+	size = strm.total_out;
+	(void)inflateEnd(&strm);
+
+	if (ret != Z_STREAM_END)
+	{
+		cerr << "The gzip data of entry " << ub->filePath << " is damaged!" << endl;
+		checkpoints.clear();
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Inflates from the nearest checkpoint before \p offset. The bytes before
+ * \p offset are decoded but not kept.
+ */
+bool ChainIndex::readGzip(uint64_t offset, size_t len, string& out)
+{
+	out.clear();
+
+	if (offset >= size || checkpoints.empty())
+		return true;
+
+	if (len > size - offset)
+		len = size - offset;
+
+	auto cp = upper_bound(checkpoints.begin(), checkpoints.end(), offset,
+		[](uint64_t off, const CHECKPOINT& c) { return off < c.out; }) - 1;
+
+	unsigned char chunk[CHUNK];
+	string input;
+	z_stream strm;
+
+	strm.zalloc = Z_NULL;
+	strm.zfree = Z_NULL;
+	strm.opaque = Z_NULL;
+	strm.avail_in = 0;
+	strm.next_in = Z_NULL;
+
+	if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+		return false;
+
+	uint64_t in = cp->in;
+	uint64_t skip = offset - cp->out;
+	int ret = Z_OK;
+
+	// A deflate block may end inside a byte. The rest of that byte
+	// belongs to the next block.
+	if (cp->bits)
+	{
+		if (!readStored(in - 1, 1, input) || input.empty())
+			ret = Z_DATA_ERROR;
+		else
+			ret = inflatePrime(&strm, cp->bits, (unsigned char)input[0] >> (8 - cp->bits));
+	}
+
+	if (ret == Z_OK && !cp->window.empty())
+		ret = inflateSetDictionary(&strm, reinterpret_cast<const Bytef *>(cp->window.data()), cp->window.length());
+
+	out.reserve(len);
+
+	while (ret == Z_OK && out.length() < len)
+	{
+		if (strm.avail_in == 0)
+		{
+			if (!readStored(in, CHUNK, input) || input.empty())
+			{
+				ret = Z_DATA_ERROR;
+				break;
+			}
+
+			in += input.length();
+			strm.next_in = reinterpret_cast<unsigned char *>(&input[0]);
+			strm.avail_in = input.length();
+		}
+
+		strm.next_out = chunk;
+		strm.avail_out = CHUNK;
+		ret = inflate(&strm, Z_NO_FLUSH);
+
+		if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+			break;
+
+		size_t have = CHUNK - strm.avail_out;
+		size_t pos = min<uint64_t>(skip, have);
+
+		skip -= pos;
+		out.append(reinterpret_cast<char *>(chunk) + pos, min(have - pos, len - out.length()));
+
+		if (ret == Z_STREAM_END)
+			break;
+
+		if (ret == Z_BUF_ERROR)
+			ret = Z_OK;
+	}
+
+	(void)inflateEnd(&strm);
+
+	if (out.length() < len)
+	{
+		cerr << "The gzip data of entry " << ub->filePath << " is damaged!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Decodes an AES entry completely.
+ */
+bool ChainIndex::decodeAll()
+{
+	string data;
+
+	if (!readStored(0, storedSize, data) || !archive.decode(coding, data, decoded))
+		return false;
+
+	size = decoded.length();
+	return true;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __CHAININDEX_H__
+#define __CHAININDEX_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "archive.h"
+
+#define CHECKPOINT_SPAN		(1024 * 1024)	// Decoded bytes between two gzip checkpoints
+#define WINDOW_SIZE			32768			// Size of the deflate window
+
+namespace reader
+{
+	/**
+	 * Gives random access to the data of one entry. The chain of the entry
+	 * is followed once and the block number of every payload is stored in
+	 * a table. If all blocks but the last are full, the block of an offset
+	 * is found by a division, otherwise by a binary search.
+	 *
+	 * gzip entries can't be entered at any byte. While the table is built,
+	 * the entry is inflated once and every CHECKPOINT_SPAN bytes a
+	 * checkpoint is set at a deflate block boundary. It holds the position
+	 * in both streams and the last 32 KiB of decoded data. A read starts
+	 * inflating at the nearest checkpoint before the offset. AES entries
+	 * are XML files and small; they are decoded completely.
+	 *
+	 * The table can be saved to a file and loaded again, so that the chain
+	 * must not be followed every time the entry is opened.
+	 */
+	class ChainIndex
+	{
+		struct CHECKPOINT
+		{
+			uint64_t out{0};			// Offset in the decoded data
+			uint64_t in{0};				// Offset in the stored data
+			int bits{0};				// Bits of the byte before "in" not used yet
+			std::string window;			// Decoded data before "out"
+		};
+
+		Archive& archive;
+		const struct USAGE_BLOCK *ub;
+		CODING coding{CODING_PLAIN};
+		std::vector<uint32_t> blocks;		// Block number of every payload
+		std::vector<uint32_t> offsets;		// Stored offset of every payload; empty if all are full
+		std::vector<CHECKPOINT> checkpoints;
+		std::string decoded;				// Decoded AES entry
+		uint64_t storedSize{0};
+		uint64_t size{0};
+
+		public:
+			ChainIndex(Archive& a, const struct USAGE_BLOCK *u)
+				: archive{a},
+				  ub{u}
+			{}
+
+			bool build();
+			bool load(const std::string& file);
+			bool save(const std::string& file);
+			bool read(uint64_t offset, size_t len, std::string& out);
+
+			uint64_t getSize() { return size; }
+			CODING getCoding() { return coding; }
+			size_t getNumCheckpoints() { return checkpoints.size(); }
+
+		private:
+			bool readStored(uint64_t offset, size_t len, std::string& out);
+			bool readGzip(uint64_t offset, size_t len, std::string& out);
+			bool setCheckpoints();
+			bool decodeAll();
+			size_t findBlock(uint64_t offset);
+	};
+}
+
+#endif
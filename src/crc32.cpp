@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <cstring>
+
+#include <zlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32_PCLMUL
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32_ARM
+#endif
+
+#include "crc32.h"
+#include "blockview.h"
+
+using namespace reader;
+using namespace std;
+
+namespace
+{
+	/*
+	 * zlib works with the final value of the CRC. The functions below work
+	 * with the inverted register value, like the hardware does.
+	 */
+	inline uint32_t softCrc(uint32_t reg, const unsigned char *p, size_t len)
+	{
+		return ~(uint32_t)crc32(~reg, p, len);
+	}
+
+#ifdef CRC32_PCLMUL
+	__attribute__((target("pclmul,sse2")))
+	inline __m128i fold(__m128i x, __m128i k, __m128i data)
+	{
+		__m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+		__m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+		return _mm_xor_si128(_mm_xor_si128(lo, hi), data);
+	}
+
+	/*
+	 * Folding with carry-less multiplication as described by Intel in "Fast
+	 * CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+	 * The constants are for the bit reflected polynomial 0x04C11DB7. At
+	 * least 64 bytes are processed in pieces of 16 bytes. The rest is left
+	 * to the caller.
+	 */
+	__attribute__((target("pclmul,sse2")))
+	uint32_t pclmulCrc(uint32_t reg, const unsigned char *&p, size_t& len)
+	{
+		const __m128i k1k2 = _mm_set_epi64x(0x1c6e41596, 0x154442bd4);	// Fold by 4 x 128 bit
+		const __m128i k3k4 = _mm_set_epi64x(0x0ccaa009e, 0x1751997d0);	// Fold by 128 bit
+		const __m128i k5 = _mm_set_epi64x(0, 0x163cd6124);
+		const __m128i poly = _mm_set_epi64x(0x1f7011641, 0x1db710641);		// u' and P(x)'
+		const __m128i mask32 = _mm_set_epi32(0, 0, 0, -1);
+
+		__m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		__m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+		__m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32));
+		__m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 48));
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(reg));
+		p += 64;
+		len -= 64;
+
+		while (len >= 64)
+		{
+			x1 = fold(x1, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+			x2 = fold(x2, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16)));
+			x3 = fold(x3, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32)));
+			x4 = fold(x4, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 48)));
+			p += 64;
+			len -= 64;
+		}
+
+		x1 = fold(x1, k3k4, x2);
+		x1 = fold(x1, k3k4, x3);
+		x1 = fold(x1, k3k4, x4);
+
+		while (len >= 16)
+		{
+			x1 = fold(x1, k3k4, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+			p += 16;
+			len -= 16;
+		}
+
+		// 128 --> 64 bit
+		__m128i t = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+		// 64 --> 32 bit
+		t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 4), t);
+		// Barrett reduction
+		t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+		t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), poly, 0x00);
+		x1 = _mm_xor_si128(x1, t);
+		return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+	}
+
+	bool hasPclmul()
+	{
+		static const bool has = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2");
+		return has;
+	}
+#endif
+
+#ifdef CRC32_ARM
+	uint32_t armCrc(uint32_t reg, const unsigned char *p, size_t len)
+	{
+		while (len >= 8)
+		{
+			uint64_t v;
+			memcpy(&v, p, sizeof(v));
+			reg = __crc32d(reg, v);
+			p += 8;
+			len -= 8;
+		}
+
+		while (len--)
+			reg = __crc32b(reg, *p++);
+
+		return reg;
+	}
+#endif
+}
+
+uint32_t Crc32::compute(uint32_t crc, const void *data, size_t len)
+{
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	uint32_t reg = ~crc;
+
+#ifdef CRC32_PCLMUL
+	if (len >= 64 && hasPclmul())
+		reg = pclmulCrc(reg, p, len);
+
+	return ~softCrc(reg, p, len);
+#elif defined(CRC32_ARM)
+	return ~armCrc(reg, p, len);
+#else
+	return ~softCrc(reg, p, len);
+#endif
+}
+
+const char *Crc32::implementation()
+{
+#ifdef CRC32_PCLMUL
+	if (hasPclmul())
+		return "pclmul";
+#elif defined(CRC32_ARM)
+	return "armv8-crc";
+#endif
+	return "zlib";
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace reader
+{
+	/**
+	 * The CRC32 used by gzip (same as crc32() of zlib). On x86 CPUs with
+	 * PCLMULQDQ and on ARMv8 CPUs with the CRC32 extension the checksum is
+	 * calculated in hardware. Otherwise zlib is used. The data may be added
+	 * in pieces of any size.
+	 */
+	class Crc32
+	{
+		public:
+			void reset() { crc = 0; }
+			void update(const void *data, size_t len) { crc = compute(crc, data, len); }
+			void update(const std::string& str) { update(str.data(), str.length()); }
+			uint32_t value() const { return crc; }
+
+			static uint32_t compute(uint32_t crc, const void *data, size_t len);
+			static const char *implementation();
+
+		private:
+			uint32_t crc{0};
+	};
+}
+
+#endif
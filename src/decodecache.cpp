@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "decodecache.h"
+#include "outdir.h"
+#include "hash.h"
+
+namespace fs = std::filesystem;
+using namespace reader;
+using namespace std;
+
+/*
+ * Creates the cache directory if it doesn't exist.
+ */
+bool DecodeCache::open()
+{
+	error_code ec;
+	fs::create_directories(dir, ec);
+
+	if (ec || !fs::is_directory(dir))
+	{
+		cerr << "Could not create the cache directory " << dir << ": " << ec.message() << endl;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Returns the name of the cache file for the raw data \p raw of an entry
+ * stored with \p coding. Two hashes with different seeds give 128 bits.
+ */
+string DecodeCache::makeKey(CODING coding, const OPTIONS& opts, const string& raw)
+{
+	string key;
+
+	for (uint64_t seed = 0; seed < 2; ++seed)
+	{
+		Hash64 hash(seed);
+		hash.update32(coding);
+
+		if (coding == CODING_AES)
+		{
+			hash.update32((uint32_t)opts.password.length());
+			hash.update(opts.password);
+			hash.update32((uint32_t)opts.salt.length());
+			hash.update(opts.salt);
+		}
+
+		hash.update(raw);
+		key += Hash64::toString(hash.digest());
+	}
+
+	return key;
+}
+
+/*
+ * The files are spread over 256 subdirectories.
+ */
+string DecodeCache::path(const string& key)
+{
+	return dir + "/" + key.substr(0, 2) + "/" + key;
+}
+
+/*
+ * Reads the decoded entry \p key into \p data. Returns FALSE if it is not
+ * in the cache.
+ */
+bool DecodeCache::lookup(const string& key, string& data)
+{
+	string file = path(key);
+	int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat st;
+
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		if (fd >= 0)
+			::close(fd);
+
+		misses++;
+		return false;
+	}
+
+	data.resize(st.st_size);
+	size_t len = 0;
+
+	while (len < data.length())
+	{
+		ssize_t r = pread(fd, &data[len], data.length() - len, len);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r <= 0)
+			break;
+
+		len += r;
+	}
+
+	// The modification time marks the last use for trim().
+	if (len == data.length())
+		futimens(fd, nullptr);
+
+	::close(fd);
+
+	if (len != data.length())
+	{
+		data.clear();
+		misses++;
+		return false;
+	}
+
+	hits++;
+	return true;
+}
+
+/*
+ * Stores the decoded entry \p data under \p key. The file appears under
+ * its name only when it is complete.
+ */
+bool DecodeCache::store(const string& key, const string& data)
+{
+	// An entry bigger than the cache would be removed again at once.
+	if (data.length() > maxBytes)
+		return false;
+
+	string file = path(key);
+	string tmp = file + ".tmp." + to_string(getpid()) + "." + to_string(hash<thread::id>()(this_thread::get_id()));
+	error_code ec;
+
+	fs::create_directories(dir + "/" + key.substr(0, 2), ec);
+	int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (fd < 0)
+		return false;
+
+	bool ok = OutputDir::writeAll(fd, data.data(), data.length());
+	::close(fd);
+
+	if (!ok || rename(tmp.c_str(), file.c_str()) != 0)
+	{
+		unlink(tmp.c_str());
+		return false;
+	}
+
+	stored++;
+	return true;
+}
+
+/*
+ * Removes the least recently used files until the cache is smaller than
+ * its limit. Temporary files older than a day are left overs of killed
+ * processes and are removed too.
+ */
+void DecodeCache::trim()
+{
+	struct CACHE_FILE
+	{
+		fs::path path;
+		uintmax_t size;
+		fs::file_time_type time;
+	};
+
+	vector<CACHE_FILE> files;
+	uintmax_t total = 0;
+	error_code ec;
+	fs::file_time_type dayAgo = fs::file_time_type::clock::now() - chrono::hours(24);
+
+	for (fs::recursive_directory_iterator itr(dir, ec), end; !ec && itr != end; itr.increment(ec))
+	{
+		// A file renamed or removed by another process meanwhile is skipped,
+		// the error of the iterator alone ends the scan
+		error_code fileEc;
+
+		if (!itr->is_regular_file(fileEc))
+			continue;
+
+		CACHE_FILE cf{itr->path(), itr->file_size(fileEc), {}};
+
+		if (fileEc)
+			continue;
+
+		cf.time = itr->last_write_time(fileEc);
+
+		if (fileEc)
+			continue;
+
+		if (cf.path.filename().string().find(".tmp.") != string::npos)
+		{
+			if (cf.time < dayAgo)
+				fs::remove(cf.path, fileEc);
+
+			continue;
+		}
+
+		total += cf.size;
+		files.push_back(cf);
+	}
+
+	if (total <= maxBytes)
+		return;
+
+	sort(files.begin(), files.end(), [](const CACHE_FILE& a, const CACHE_FILE& b) { return a.time < b.time; });
+
+	for (auto itr = files.begin(); itr != files.end() && total > maxBytes; ++itr)
+	{
+		error_code fileEc;
+
+		if (fs::remove(itr->path, fileEc))
+			total -= itr->size;
+	}
+}
+
+void DecodeCache::printStats()
+{
+	cout << "Decode cache " << dir << ": " << hits << " hits, " << misses << " misses, " << stored << " stored." << endl;
+}
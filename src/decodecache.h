@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __DECODECACHE_H__
+#define __DECODECACHE_H__
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+#include "archive.h"
+
+#define DECODE_CACHE_SIZE	1024	// Default size limit in MiB
+
+namespace reader
+{
+	/**
+	 * A directory holding decoded entries. The name of a file is a 128 bit
+	 * hash of the raw data of the entry, the coding and, for AES, the
+	 * password and salt. An entry found in the cache is read from there
+	 * instead of being inflated or decrypted again. This helps when the
+	 * same files appear in many archives or revisions of an archive.
+	 *
+	 * Files are written under a temporary name and renamed, so several
+	 * processes may share the directory. The modification time of a file
+	 * is set when it is used. trim() removes the least recently used files
+	 * until the directory is below its size limit. lookup() and store()
+	 * may be called from several threads at the same time.
+	 */
+	class DecodeCache
+	{
+		std::string dir;
+		uint64_t maxBytes;
+		std::atomic<size_t> hits{0};
+		std::atomic<size_t> misses{0};
+		std::atomic<size_t> stored{0};
+
+		public:
+			explicit DecodeCache(const std::string& d, uint64_t maxMiB = DECODE_CACHE_SIZE)
+				: dir{d},
+				  maxBytes{maxMiB * 1024 * 1024}
+			{}
+
+			bool open();
+			bool lookup(const std::string& key, std::string& data);
+			bool store(const std::string& key, const std::string& data);
+			void trim();
+			void printStats();
+
+			static std::string makeKey(CODING coding, const OPTIONS& opts, const std::string& raw);
+
+		private:
+			std::string path(const std::string& key);
+	};
+}
+
+#endif
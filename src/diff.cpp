@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+
+#include "diff.h"
+#include "hash.h"
+#include "parallel.h"
+
+using namespace reader;
+using namespace std;
+
+/*
+ * Returns 0 if both files have the same content, 1 if there are
+ * differences and 2 on error.
+ */
+int Diff::doDiff()
+{
+	if (!archiveA.open() || !archiveA.readIndex() || !archiveB.open() || !archiveB.readIndex())
+		return 2;
+
+	unordered_map<string_view, const struct USAGE_BLOCK *> mapB;
+	vector<DIFF_ENTRY> result;
+	vector<size_t> check;
+
+	for (struct INDEX *act = archiveB.getIndex(); act != nullptr; act = act->next)
+		mapB.insert(pair<string_view, const struct USAGE_BLOCK *>(act->ublock->filePath, act->ublock));
+
+	for (struct INDEX *act = archiveA.getIndex(); act != nullptr; act = act->next)
+	{
+		DIFF_ENTRY entry;
+		entry.path.assign(act->ublock->filePath);
+		entry.a = act->ublock;
+		auto itr = mapB.find(entry.path);
+
+		if (itr == mapB.end())
+			entry.state = DIFF_REMOVED;
+		else
+		{
+			entry.b = itr->second;
+			mapB.erase(itr);
+
+			if (entry.a->sizeBytes != entry.b->sizeBytes)
+			{
+				entry.state = DIFF_MODIFIED;
+				entry.reason = "size";
+			}
+			else if (entry.a->tmModify != entry.b->tmModify || content)
+				entry.state = DIFF_UNSURE;
+		}
+
+		if (entry.state == DIFF_UNSURE || (content && entry.state == DIFF_MODIFIED))
+			check.push_back(result.size());
+
+		result.push_back(entry);
+	}
+
+	for (struct INDEX *act = archiveB.getIndex(); act != nullptr; act = act->next)
+	{
+		if (mapB.find(act->ublock->filePath) == mapB.end())
+			continue;
+
+		DIFF_ENTRY entry;
+		entry.path.assign(act->ublock->filePath);
+		entry.b = act->ublock;
+		entry.state = DIFF_ADDED;
+		result.push_back(entry);
+	}
+
+	parallelFor(check.size(), [&](size_t i)
+	{
+		compareData(result[check[i]]);
+	}, threads);
+
+	sort(result.begin(), result.end(), [](const DIFF_ENTRY& e1, const DIFF_ENTRY& e2) { return e1.path < e2.path; });
+	bool differ = false;
+	bool error = false;
+
+	for (auto itr = result.begin(); itr != result.end(); ++itr)
+	{
+		char state;
+
+		switch(itr->state)
+		{
+			case DIFF_ADDED:	state = 'A'; break;
+			case DIFF_REMOVED:	state = 'D'; break;
+			case DIFF_MODIFIED:	state = 'M'; break;
+			case DIFF_UNSURE:	state = '?'; error = true; break;
+			default:
+				state = '=';
+		}
+
+		if (state == '=' && !verbose)
+			continue;
+
+		if (state != '=')
+			differ = true;
+
+		cout << state << "\t" << (itr->a ? to_string(itr->a->sizeBytes) : string("-"))
+			 << "\t" << (itr->b ? to_string(itr->b->sizeBytes) : string("-"))
+			 << "\t" << (itr->reason.empty() ? string("-") : itr->reason)
+			 << "\t" << itr->path << endl;
+	}
+
+	if (error)
+		return 2;
+
+	return differ ? 1 : 0;
+}
+
+/*
+ * Compares the data of an entry present in both files. First the raw block
+ * chains are hashed. If content should be compared and the raw data
+ * differs, both entries are decoded and compared.
+ */
+void Diff::compareData(DIFF_ENTRY& entry)
+{
+	uint64_t hashA, hashB;
+	string dataA, dataB;
+	string *pA = content ? &dataA : nullptr;
+	string *pB = content ? &dataB : nullptr;
+
+	if (!hashChain(archiveA, entry.a, hashA, pA) || !hashChain(archiveB, entry.b, hashB, pB))
+	{
+		entry.state = DIFF_UNSURE;
+		entry.reason = "unreadable";
+		return;
+	}
+
+	if (hashA == hashB)
+	{
+		entry.state = DIFF_SAME;
+		return;
+	}
+
+	entry.state = DIFF_MODIFIED;
+
+	if (entry.reason.empty())
+		entry.reason = "data";
+
+	if (!content)
+		return;
+
+	string name = entry.path;
+	CODING codingA = Archive::detectCoding(name, reinterpret_cast<const unsigned char *>(dataA.data()), dataA.length());
+	CODING codingB = Archive::detectCoding(name, reinterpret_cast<const unsigned char *>(dataB.data()), dataB.length());
+
+	if (codingA == CODING_PLAIN && codingB == CODING_PLAIN)
+		return;
+
+	string decA, decB;
+
+	if (!archiveA.decode(codingA, dataA, decA, true) || !archiveB.decode(codingB, dataB, decB, true))
+	{
+		entry.reason = "undecodable";
+		return;
+	}
+
+	if (decA == decB)
+	{
+		entry.state = DIFF_SAME;
+		entry.reason.clear();
+	}
+	else
+		entry.reason = "content";
+}
+
+bool Diff::hashChain(Archive& archive, const struct USAGE_BLOCK *ub, uint64_t& hash, string *data)
+{
+	string raw;
+
+	if (!archive.readChain(ub, raw))
+		return false;
+
+	hash = Hash64::hash(raw.data(), raw.length());
+
+	if (data)
+		data->swap(raw);
+
+	return true;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __DIFF_H__
+#define __DIFF_H__
+
+#include <string>
+#include <vector>
+
+#include "archive.h"
+
+namespace reader
+{
+	typedef enum
+	{
+		DIFF_SAME,
+		DIFF_ADDED,
+		DIFF_REMOVED,
+		DIFF_MODIFIED,
+		DIFF_UNSURE			// Same size but different time; must be hashed
+	}DIFF_STATE;
+
+	struct DIFF_ENTRY
+	{
+		std::string path;
+		const struct USAGE_BLOCK *a{nullptr};
+		const struct USAGE_BLOCK *b{nullptr};
+		DIFF_STATE state{DIFF_SAME};
+		std::string reason;
+	};
+
+	/**
+	 * Compares two FSF files. The indexes are compared by path, size and
+	 * modification time first. Only entries with the same size but a
+	 * different time (or all entries of equal size if content is compared)
+	 * are read: their raw block chains are hashed in parallel. If the
+	 * content should be compared, entries with different raw data are
+	 * decoded and the decoded data is compared.
+	 *
+	 * The result is written to stdout, one entry per line:
+	 *
+	 *     <state> TAB <size a> TAB <size b> TAB <reason> TAB <path>
+	 *
+	 * where state is A (added), D (removed), M (modified) or = (same; only
+	 * if verbose). A missing size is written as "-". The archives are read
+	 * without the verbose option, so nothing else is written to stdout.
+	 */
+	class Diff
+	{
+		Archive archiveA;
+		Archive archiveB;
+		unsigned threads{0};
+		bool content{false};
+		bool verbose{false};
+
+		public:
+			Diff(const std::string& fa, const std::string& fb, const OPTIONS& opts = OPTIONS())
+				: archiveA{fa, quiet(opts)},
+				  archiveB{fb, quiet(opts)},
+				  verbose{opts.verbose}
+			{}
+
+			int doDiff();
+			void setThreads(unsigned t) { threads = t; }
+			void setContent(bool c) { content = c; }
+
+		private:
+			static OPTIONS quiet(OPTIONS opts) { opts.verbose = false; return opts; }
+			void compareData(DIFF_ENTRY& entry);
+			bool hashChain(Archive& archive, const struct USAGE_BLOCK *ub, uint64_t& hash, std::string *data);
+	};
+}
+
+#endif
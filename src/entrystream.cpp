@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+
+#include "entrystream.h"
+
+using namespace reader;
+using namespace std;
+
+EntryStreambuf::EntryStreambuf(Archive& a, const struct USAGE_BLOCK *u)
+	: archive{a},
+	  ub{u}
+{
+	nextBlock = ub->startBlock;
+	setg(buffer, buffer, buffer);
+}
+
+EntryStreambuf::~EntryStreambuf()
+{
+	if (zInit)
+		(void)inflateEnd(&strm);
+}
+
+EntryStreambuf::int_type EntryStreambuf::underflow()
+{
+	if (gptr() < egptr())
+		return traits_type::to_int_type(*gptr());
+
+	if (error || finished)
+		return traits_type::eof();
+
+	if (!started)
+	{
+		ByteSpan payload;
+
+		if (!readPayload(payload))
+			return traits_type::eof();
+
+		started = true;
+
+		if (!start(payload))
+			return traits_type::eof();
+
+		if (coding == CODING_PLAIN)
+		{
+			char *p = const_cast<char *>(payload.chars());
+			setg(p, p, p + payload.size);
+		}
+
+		if (gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+	}
+
+	if (coding == CODING_GZIP)
+		return underflowGzip();
+	else if (coding == CODING_AES)
+		return underflowAes();
+
+	// Plain entries are handed out directly from the block.
+	ByteSpan payload;
+
+	while (readPayload(payload))
+	{
+		if (payload.size == 0)
+			continue;
+
+		char *p = const_cast<char *>(payload.chars());
+		setg(p, p, p + payload.size);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	return traits_type::eof();
+}
+
+/*
+ * Reads the next block of the chain. Returns FALSE at the end of the
+ * chain or on an error.
+ */
+bool EntryStreambuf::readPayload(ByteSpan& payload)
+{
+	if (blocksRead >= ub->sizeBlocks)
+	{
+		finished = true;
+		return false;
+	}
+
+	BlockView block(memblock);
+
+	if (!archive.readBlock(nextBlock, memblock))
+	{
+		error = true;
+		return false;
+	}
+
+	if (block.thisBlock() != nextBlock)
+	{
+		fail("Block " + to_string(nextBlock) + " is damaged");
+		return false;
+	}
+
+	payload = block.payload();
+	nextBlock = archive.nextLink(block);
+	blocksRead++;
+	return true;
+}
+
+/*
+ * Detects the coding with the first block and prepares the decoder. The
+ * payload is given to the decoder as its first input.
+ */
+bool EntryStreambuf::start(ByteSpan& payload)
+{
+	coding = Archive::detectCoding(ub->filePath, BlockView(memblock).rawPayload().data, SIZE_PAYLOAD);
+
+	if (coding == CODING_GZIP)
+	{
+		size_t header = Expand::skipHeader(payload.data, payload.size);
+
+		if (!header)
+		{
+			fail("Invalid gzip header");
+			return false;
+		}
+
+		strm.zalloc = Z_NULL;
+		strm.zfree = Z_NULL;
+		strm.opaque = Z_NULL;
+		strm.avail_in = 0;
+		strm.next_in = Z_NULL;
+
+		if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+		{
+			fail("Can't initialize zlib");
+			return false;
+		}
+
+		zInit = true;
+		strm.next_in = const_cast<unsigned char *>(payload.data + header);
+		strm.avail_in = payload.size - header;
+	}
+	else if (coding == CODING_AES)
+	{
+		const OPTIONS& opts = archive.getOptions();
+		scr.setVerbose(opts.verbose);
+
+		if (!scr.aesInit(opts.password, opts.salt) || !scr.aesDecodeUpdate(payload.data, payload.size, decrypted))
+		{
+			error = true;
+			return false;
+		}
+
+		setg(&decrypted[0], &decrypted[0], &decrypted[0] + decrypted.length());
+	}
+
+	return true;
+}
+
+EntryStreambuf::int_type EntryStreambuf::underflowGzip()
+{
+	while (true)
+	{
+		if (strm.avail_in == 0)
+		{
+			ByteSpan payload;
+
+			if (!readPayload(payload))
+				return error ? traits_type::eof() : fail("The gzip data is truncated");
+
+			strm.next_in = const_cast<unsigned char *>(payload.data);
+			strm.avail_in = payload.size;
+		}
+
+		strm.next_out = reinterpret_cast<unsigned char *>(buffer);
+		strm.avail_out = CHUNK;
+		int ret = inflate(&strm, Z_NO_FLUSH);
+
+		if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+			return fail(strm.msg ? strm.msg : "Damaged gzip data");
+
+		size_t have = CHUNK - strm.avail_out;
+		crc.update(buffer, have);
+
+		if (ret == Z_STREAM_END && !checkTrailer())
+			return traits_type::eof();
+
+		if (have > 0)
+		{
+			setg(buffer, buffer, buffer + have);
+			return traits_type::to_int_type(*gptr());
+		}
+
+		if (ret == Z_STREAM_END)
+			return traits_type::eof();
+	}
+}
+
+/*
+ * Compares CRC32 and ISIZE with the trailer following the deflate data.
+ * The trailer may continue in the next block.
+ */
+bool EntryStreambuf::checkTrailer()
+{
+	string trailer(reinterpret_cast<char *>(strm.next_in), strm.avail_in < 8 ? strm.avail_in : 8);
+	ByteSpan payload;
+
+	while (trailer.length() < 8 && readPayload(payload))
+		trailer.append(payload.chars(), min(payload.size, 8 - trailer.length()));
+
+	finished = true;
+	const unsigned char *t = reinterpret_cast<const unsigned char *>(trailer.data());
+
+	if (trailer.length() < 8)
+		fail("gzip trailer is missing");
+	else if (loadLE32(t) != crc.value())
+		fail("CRC32 mismatch");
+	else if (loadLE32(t + 4) != (strm.total_out & 0xffffffff))
+		fail("ISIZE mismatch");
+
+	return !error;
+}
+
+EntryStreambuf::int_type EntryStreambuf::underflowAes()
+{
+	ByteSpan payload;
+
+	decrypted.clear();
+
+	// The cipher holds back the last block of every piece, so a piece
+	// may give no clear text at all.
+	while (decrypted.empty())
+	{
+		if (!readPayload(payload))
+		{
+			if (error || !scr.aesDecodeFinal(decrypted))
+				return fail("Invalid AES padding (damaged data or wrong password/salt)");
+
+			if (decrypted.empty())
+				return traits_type::eof();
+
+			break;
+		}
+
+		if (!scr.aesDecodeUpdate(payload.data, payload.size, decrypted))
+			return fail("Damaged AES data");
+	}
+
+	setg(&decrypted[0], &decrypted[0], &decrypted[0] + decrypted.length());
+	return traits_type::to_int_type(*gptr());
+}
+
+EntryStreambuf::int_type EntryStreambuf::fail(const string& msg)
+{
+	if (!error)
+		cerr << "Error reading " << ub->filePath << ": " << msg << endl;
+
+	error = true;
+	return traits_type::eof();
+}
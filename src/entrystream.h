@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __ENTRYSTREAM_H__
+#define __ENTRYSTREAM_H__
+
+#include <string>
+#include <istream>
+#include <streambuf>
+#include <zlib.h>
+
+#include "archive.h"
+#include "scramble.h"
+#include "crc32.h"
+#include "expand.h"
+
+namespace reader
+{
+	/**
+	 * A stream buffer reading the decoded data of one entry. The blocks of
+	 * the chain are read one by one when the reader needs more data. gzip
+	 * entries are inflated and AES entries are decrypted into a buffer of
+	 * CHUNK bytes. Plain entries are handed out directly from the block.
+	 * Only one block and the buffer are held in memory, however big the
+	 * entry is.
+	 *
+	 * At the end of a gzip entry the CRC32 and the size are compared with
+	 * the trailer. If the entry is damaged, the stream ends early and
+	 * failed() returns TRUE.
+	 */
+	class EntryStreambuf : public std::streambuf
+	{
+		Archive& archive;
+		const struct USAGE_BLOCK *ub;
+		CODING coding{CODING_PLAIN};
+		unsigned char memblock[SIZE_BLOCK];
+		uint32_t nextBlock{0};
+		uint32_t blocksRead{0};
+		bool started{false};
+		bool finished{false};
+		bool error{false};
+
+		// gzip
+		z_stream strm;
+		bool zInit{false};
+		Crc32 crc;
+		char buffer[CHUNK];
+
+		// AES
+		Scramble scr;
+		std::string decrypted;
+
+		public:
+			EntryStreambuf(Archive& a, const struct USAGE_BLOCK *u);
+			~EntryStreambuf();
+
+			bool failed() const { return error; }
+			CODING getCoding() const { return coding; }
+
+		protected:
+			int_type underflow() override;
+
+		private:
+			bool readPayload(ByteSpan& payload);
+			bool start(ByteSpan& payload);
+			int_type underflowGzip();
+			int_type underflowAes();
+			bool checkTrailer();
+			int_type fail(const std::string& msg);
+	};
+
+	/**
+	 * An input stream over the decoded data of one entry.
+	 */
+	class EntryStream : public std::istream
+	{
+		EntryStreambuf buf;
+
+		public:
+			EntryStream(Archive& a, const struct USAGE_BLOCK *u)
+				: std::istream(nullptr),
+				  buf(a, u)
+			{
+				rdbuf(&buf);
+			}
+
+			bool failed() const { return buf.failed(); }
+	};
+}
+
+#endif
@@ -24,6 +24,8 @@
 #include <filesystem>
 #endif
 #include "expand.h"
+#include "crc32.h"
+#include "blockview.h"
 #include <assert.h>
 
 using namespace std;
@@ -148,8 +150,210 @@ int Expand::unzip()
 	return ret == Z_STREAM_END ? Z_OK : Z_DATA_ERROR;
 }
 
+/*
+ * Decompresses the buffer \p buf in memory and appends the result to
+ * \p out. No temporary file is used. The CRC32 and the size in the gzip
+ * trailer are checked.
+ */
+int Expand::unzip(const unsigned char *buf, size_t len, string& out)
+{
+	return inflateGzip(buf, len, &out);
+}
+
+/*
+ * Tests the gzip stream in \p buf like unzip() but without keeping the
+ * decompressed data.
+ */
+int Expand::check(const unsigned char *buf, size_t len)
+{
+	return inflateGzip(buf, len, nullptr);
+}
+
+/*
+ * Returns the length of the gzip header (RFC 1952) at the start of \p buf
+ * or 0 if there is no valid header.
+ */
+size_t Expand::skipHeader(const unsigned char *buf, size_t len)
+{
+	if (len < 10 || buf[0] != 0x1f || buf[1] != 0x8b || buf[2] != Z_DEFLATED)
+		return 0;
+
+	unsigned char flags = buf[3];
+	size_t pos = 10;
+
+	if (flags & 0x04)		// FEXTRA
+	{
+		if (pos + 2 > len)
+			return 0;
+
+		pos += 2 + (buf[pos] | (buf[pos+1] << 8));
+	}
+
+	for (unsigned char f = 0x08; f <= 0x10; f <<= 1)		// FNAME, FCOMMENT
+	{
+		if (!(flags & f))
+			continue;
+
+		while (pos < len && buf[pos] != 0)
+			pos++;
+
+		pos++;
+	}
+
+	if (flags & 0x02)		// FHCRC
+		pos += 2;
+
+	return pos < len ? pos : 0;
+}
+
+/*
+ * Inflates the raw deflate data of a gzip stream. zlib doesn't look at the
+ * gzip header and trailer. The CRC32 is calculated with Crc32, which is much
+ * faster than the one of zlib. If \p out is NULL the data is only checked.
+ */
+int Expand::inflateGzip(const unsigned char *buf, size_t len, string *out)
+{
+	int ret;
+	z_stream strm;
+	unsigned char chunk[CHUNK];
+	reader::Crc32 crc;
+
+	mError.clear();
+	size_t header = skipHeader(buf, len);
+
+	if (!header)
+	{
+		mError = "invalid gzip header";
+
+		if (!mQuiet)
+			cerr << mError << endl;
+
+		return Z_DATA_ERROR;
+	}
+
+	strm.zalloc = Z_NULL;
+	strm.zfree = Z_NULL;
+	strm.opaque = Z_NULL;
+	strm.avail_in = 0;
+	strm.next_in = Z_NULL;
+	ret = inflateInit2(&strm, -MAX_WBITS);
+
+	if (ret != Z_OK)
+	{
+		zerr(ret);
+		return ret;
+	}
+
+	strm.next_in = const_cast<unsigned char *>(buf + header);
+	strm.avail_in = len - header;
+
+	do
+	{
+		strm.avail_out = CHUNK;
+		strm.next_out = chunk;
+		ret = inflate(&strm, Z_NO_FLUSH);
+		assert(ret != Z_STREAM_ERROR);	// state not clobbered
+
+		switch (ret)
+		{
+			case Z_NEED_DICT:
+				ret = Z_DATA_ERROR;
+			// fall through
+			case Z_DATA_ERROR:
+			case Z_MEM_ERROR:
+				(void)inflateEnd(&strm);
+				zerr(ret);
+				return ret;
+		}
+
+		crc.update(chunk, CHUNK - strm.avail_out);
+
+		if (out)
+			out->append(reinterpret_cast<char *>(chunk), CHUNK - strm.avail_out);
+
+		if (ret == Z_BUF_ERROR)		// Input is truncated
+			break;
+	}
+	while (ret != Z_STREAM_END);
+
+	size_t rest = strm.avail_in;
+	uint32_t isize = strm.total_out & 0xffffffff;
+	(void)inflateEnd(&strm);
+
+	if (ret != Z_STREAM_END)
+	{
+		zerr(Z_DATA_ERROR);
+		return Z_DATA_ERROR;
+	}
+
+	// The trailer: CRC32 and size of the uncompressed data (ISIZE)
+	const unsigned char *trailer = buf + len - rest;
+
+	if (rest < 8)
+		mError = "gzip trailer is missing";
+	else if (reader::loadLE32(trailer) != crc.value())
+		mError = "CRC32 mismatch (" + to_string(reader::loadLE32(trailer)) + " expected, " + to_string(crc.value()) + " found)";
+	else if (reader::loadLE32(trailer + 4) != isize)
+		mError = "ISIZE mismatch (" + to_string(reader::loadLE32(trailer + 4)) + " expected, " + to_string(isize) + " found)";
+
+	if (!mError.empty())
+	{
+		if (!mQuiet)
+			cerr << mError << endl;
+
+		return Z_DATA_ERROR;
+	}
+
+	return Z_OK;
+}
+
+/*
+ * Compresses the buffer \p buf in memory into a gzip stream and appends it
+ * to \p out.
+ */
+int Expand::zip(const unsigned char *buf, size_t len, string& out)
+{
+	int ret;
+	z_stream strm;
+	unsigned char chunk[CHUNK];
+
+	strm.zalloc = Z_NULL;
+	strm.zfree = Z_NULL;
+	strm.opaque = Z_NULL;
+	// 16 + MAX_WBITS writes a gzip header instead of a zlib header.
+	ret = deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, 16+MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+
+	if (ret != Z_OK)
+	{
+		zerr(ret);
+		return ret;
+	}
+
+	strm.next_in = const_cast<unsigned char *>(buf);
+	strm.avail_in = len;
+
+	do
+	{
+		strm.avail_out = CHUNK;
+		strm.next_out = chunk;
+		ret = deflate(&strm, Z_FINISH);
+		assert(ret != Z_STREAM_ERROR);	// state not clobbered
+		out.append(reinterpret_cast<char *>(chunk), CHUNK - strm.avail_out);
+	}
+	while (ret != Z_STREAM_END);
+
+	(void)deflateEnd(&strm);
+	return Z_OK;
+}
+
 void Expand::zerr(int ret)
 {
+	if (ret == Z_DATA_ERROR)
+		mError = "invalid or incomplete deflate data";
+
+	if (mQuiet)
+		return;
+
     switch (ret)
 	{
 		case Z_ERRNO:
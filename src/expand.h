@@ -27,15 +27,27 @@
 class Expand
 {
 	std::string fname;
+	bool mQuiet{false};
 
 	public:
+		Expand() {}
 		explicit Expand(const std::string& fn) : fname{fn} {}
 
 		void setFileName(const std::string& fn);
 		int unzip();
+		int unzip(const unsigned char *buf, size_t len, std::string& out);
+		int check(const unsigned char *buf, size_t len);
+		int zip(const unsigned char *buf, size_t len, std::string& out);
+		void setQuiet(bool q) { mQuiet = q; }
+		const std::string& getError() { return mError; }
+
+		static size_t skipHeader(const unsigned char *buf, size_t len);
 
 	private:
+		int inflateGzip(const unsigned char *buf, size_t len, std::string *out);
 		void zerr(int err);
+
+		std::string mError;
 };
 
 #endif
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <sstream>
+
+#include <fnmatch.h>
+
+#include "filter.h"
+
+using namespace reader;
+using namespace std;
+
+/*
+ * Adds a comma separated list of types. Possible types are "xml", "image",
+ * "sound", "font" and "other". Returns FALSE if an unknown type was found.
+ */
+bool EntryFilter::addTypes(const string& list)
+{
+	stringstream s(list);
+	string type;
+
+	while (getline(s, type, ','))
+	{
+		if (type.compare("xml") == 0)
+			types |= TYPE_XML;
+		else if (type.compare("image") == 0)
+			types |= TYPE_IMAGE;
+		else if (type.compare("sound") == 0)
+			types |= TYPE_SOUND;
+		else if (type.compare("font") == 0)
+			types |= TYPE_FONT;
+		else if (type.compare("other") == 0)
+			types |= TYPE_OTHER;
+		else
+		{
+			cerr << "Unknown file type " << type << "!" << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool EntryFilter::match(const string& path) const
+{
+	if (types != 0 && (types & entryType(path)) == 0)
+		return false;
+
+	if (!includes.empty())
+	{
+		bool found = false;
+
+		for (auto itr = includes.begin(); itr != includes.end(); ++itr)
+		{
+			if (fnmatch(itr->c_str(), path.c_str(), FNM_CASEFOLD) == 0)
+			{
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+			return false;
+	}
+
+	for (auto itr = excludes.begin(); itr != excludes.end(); ++itr)
+	{
+		if (fnmatch(itr->c_str(), path.c_str(), FNM_CASEFOLD) == 0)
+			return false;
+	}
+
+	return true;
+}
+
+ENTRY_TYPE EntryFilter::entryType(string_view f)
+{
+	// The order is the one of the directories of the transfer mode: A
+	// name like "tree.xmas.png" is an image.
+	if (f.find(".png") != string::npos || f.find(".jpg") != string::npos ||
+			f.find(".gif") != string::npos || f.find(".tiff") != string::npos)
+		return TYPE_IMAGE;
+
+	if (f.find(".wav") != string::npos || f.find(".mp3") != string::npos)
+		return TYPE_SOUND;
+
+	if (f.find(".ttf") != string::npos)
+		return TYPE_FONT;
+
+	if (f.find(".xma") != string::npos || f.find(".xml") != string::npos)
+		return TYPE_XML;
+
+	return TYPE_OTHER;
+}
+
+/*
+ * Returns the directory used for files of \p type in transfer mode.
+ */
+string EntryFilter::typeDirectory(ENTRY_TYPE type)
+{
+	switch(type)
+	{
+		case TYPE_IMAGE:	return "/images";
+		case TYPE_SOUND:	return "/sounds";
+		case TYPE_FONT:		return "/fonts";
+		default:
+			return "";
+	}
+}
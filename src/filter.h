@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <string>
+#include <vector>
+#include <string_view>
+
+namespace reader
+{
+	typedef enum
+	{
+		TYPE_XML = 0x01,		// .xma, .xml
+		TYPE_IMAGE = 0x02,		// .png, .jpg, .gif, .tiff
+		TYPE_SOUND = 0x04,		// .wav, .mp3
+		TYPE_FONT = 0x08,		// .ttf
+		TYPE_OTHER = 0x10
+	}ENTRY_TYPE;
+
+	/**
+	 * Decides which entries of a file are selected. An entry is selected if
+	 * it matches at least one include pattern (or there is none), matches no
+	 * exclude pattern and is of one of the selected types (or no type was
+	 * selected). The patterns are shell globs as understood by fnmatch().
+	 */
+	class EntryFilter
+	{
+		std::vector<std::string> includes;
+		std::vector<std::string> excludes;
+		unsigned types{0};
+
+		public:
+			void addInclude(const std::string& pattern) { includes.push_back(pattern); }
+			void addExclude(const std::string& pattern) { excludes.push_back(pattern); }
+			bool addTypes(const std::string& list);
+			bool empty() const { return includes.empty() && excludes.empty() && types == 0; }
+			bool match(const std::string& path) const;
+
+			static ENTRY_TYPE entryType(std::string_view path);
+			static std::string typeDirectory(ENTRY_TYPE type);
+	};
+}
+
+#endif
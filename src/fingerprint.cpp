@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+
+#include "fingerprint.h"
+#include "parallel.h"
+#include "hash.h"
+
+using namespace reader;
+using namespace std;
+
+bool Fingerprint::doFingerprint()
+{
+	if (!archive.open() || !archive.readIndex())
+		return false;
+
+	const vector<struct INDEX *>& entries = archive.getEntries();
+	vector<uint64_t> blockDigests;
+	atomic<bool> ok{true};
+
+	// The blocks of the entries are read in parallel. Their digests are
+	// added in the order of the index.
+	if (strong)
+	{
+		blockDigests.resize(entries.size());
+
+		parallelFor(entries.size(), [&](size_t i)
+		{
+			if (!hashBlocks(entries[i]->ublock, blockDigests[i]))
+				ok = false;
+		}, threads);
+
+		if (!ok)
+			return false;
+	}
+
+	string digest;
+
+	// The level is part of the seed, so the digests of both levels differ.
+	for (uint64_t seed = strong ? 2 : 0; digest.length() < 32; ++seed)
+	{
+		Hash64 hash(seed);
+		hash.update32(archive.getListStartBlock());
+		hash.update32(archive.getNumBlocks());
+		hash.update32((uint32_t)entries.size());
+
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			const struct USAGE_BLOCK *ub = entries[i]->ublock;
+			hash.update32(ub->thisBlock);
+			hash.update32(ub->prevBlock);
+			hash.update32(ub->nextBlock);
+			hash.update32(ub->bytesUsed);
+			hash.update32((uint32_t)ub->filePath.length());
+			hash.update(ub->filePath.data(), ub->filePath.length());
+			hash.update32((uint32_t)ub->tmCreate);
+			hash.update32((uint32_t)ub->tmModify);
+			hash.update32(ub->flags);
+			hash.update32(ub->startBlock);
+			hash.update32(ub->sizeBlocks);
+			hash.update32(ub->sizeBytes);
+
+			if (strong)
+				hash.update(&blockDigests[i], sizeof(uint64_t));
+		}
+
+		digest += Hash64::toString(hash.digest());
+	}
+
+	cout << digest << "  " << archive.getFileName() << endl;
+	return true;
+}
+
+/*
+ * Hashes the first and the last block of the entry \p ub. The last block
+ * is expected behind the first one. It is taken only if the first block
+ * links to its neighbour and the last one ends a chain and links back to
+ * its neighbour too, so the end of another chain isn't taken. Otherwise
+ * the chain is followed to find it.
+ */
+bool Fingerprint::hashBlocks(const struct USAGE_BLOCK *ub, uint64_t& digest)
+{
+	unsigned char memblock[SIZE_BLOCK] = {0};
+	BlockView block(memblock);
+	Hash64 hash;
+
+	digest = 0;
+
+	if (ub->sizeBlocks == 0)
+		return true;
+
+	if (!archive.readBlock(ub->startBlock, memblock))
+		return false;
+
+	hash.update(memblock, SIZE_BLOCK);
+
+	if (ub->sizeBlocks > 1)
+	{
+		uint64_t last = (uint64_t)ub->startBlock + ub->sizeBlocks - 1;
+
+		if (block.nextBlock() != ub->startBlock + 1 ||
+			last >= archive.getNumBlocks() || !archive.readBlock((uint32_t)last, memblock) ||
+			block.thisBlock() != last || block.nextBlock() != 0 || block.prevBlock() != last - 1)
+		{
+			uint32_t nextBlock = ub->startBlock;
+
+			for (uint32_t i = 0; i < ub->sizeBlocks; ++i)
+			{
+				if (!archive.readBlock(nextBlock, memblock))
+					return false;
+
+				nextBlock = block.nextBlock();
+			}
+		}
+
+		hash.update(memblock, SIZE_BLOCK);
+	}
+
+	digest = hash.digest();
+	return true;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __FINGERPRINT_H__
+#define __FINGERPRINT_H__
+
+#include <string>
+#include <cstdint>
+
+#include "archive.h"
+
+namespace reader
+{
+	/**
+	 * Calculates a 128 bit digest of an FSF file without reading its data.
+	 * Only the header and the index are hashed: path, times, flags, sizes
+	 * and block pointers of every entry. If the digest didn't change, the
+	 * file most likely didn't change either. The strong level also hashes
+	 * the first and the last block of every entry, which catches changes
+	 * of the data with the same size and time.
+	 */
+	class Fingerprint
+	{
+		Archive archive;
+		bool strong{false};
+		unsigned threads{0};
+
+		public:
+			explicit Fingerprint(const std::string& fn, const OPTIONS& opts = OPTIONS())
+				: archive{fn, opts}
+			{}
+
+			bool doFingerprint();
+			void setStrong(bool s) { strong = s; }
+			void setThreads(unsigned t) { threads = t; }
+
+		private:
+			bool hashBlocks(const struct USAGE_BLOCK *ub, uint64_t& digest);
+	};
+}
+
+#endif
@@ -21,17 +21,26 @@
 #include <fstream>
 #include <cstdlib>
 #include <filesystem>
+#include <unistd.h>
 #include "fsfreader.h"
 #include "readtp4.h"
+#include "verify.h"
+#include "diff.h"
+#include "transcode.h"
+#include "analyze.h"
+#include "chainindex.h"
+#include "entrystream.h"
+#include "server.h"
+#include "fingerprint.h"
+#include "keyprobe.h"
+#include "trace.h"
+#include "watch.h"
+#include "outdir.h"
 
 namespace fs = std::filesystem;
 using namespace std;
 
 string prgName;
-bool verbose;
-bool transfer;
-string password = "8P0puxB5OVUFI6uX";
-string salt = "MarkRobs";
 
 void usage();
 void version();
@@ -39,6 +48,38 @@ void version();
 int main (int argc, char **argv)
 {
 	string fname, outdir;
+	reader::WRITER_TYPE writerType = reader::WRITER_BUFFERED;
+	bool stats = false;
+	bool verifyMode = false;
+	bool analyzeMode = false;
+	bool contentDiff = false;
+	string diffA, diffB;
+	unsigned threads = 0;
+	string tarFile;
+	string transcodeFile;
+	string defragFile;
+	string catEntry;
+	string chainIndex;
+	uint64_t catOffset = 0;
+	size_t catLength = SIZE_MAX;
+	int catFd = -1;
+	string serveSocket;
+	string clientSocket;
+	bool listMode = false;
+	bool stopMode = false;
+	bool fingerprintMode = false;
+	bool strongFingerprint = false;
+	bool autoKey = false;
+	string keyring;
+	string traceFile;
+	string watchDir;
+	string cacheDir;
+	unsigned cacheSize = DECODE_CACHE_SIZE;
+	string xmlIndex;
+	reader::CODING transcodeTo = reader::CODING_PLAIN;
+	int tarFd = -1;
+	reader::EntryFilter filter;
+	reader::OPTIONS options;
 
 	prgName.assign(*argv);
 	size_t pos = prgName.find_last_of("/");
@@ -46,8 +87,33 @@ int main (int argc, char **argv)
 	if (pos != string::npos)
 		prgName = prgName.substr(pos+1);
 
-	verbose = transfer = false;
-	version();
+	bool banner = true;
+
+	// Machine readable output must not be mixed with the banner.
+	for (int i = 1; i < argc; ++i)
+	{
+		if (string(argv[i]).compare("--diff") == 0 || string(argv[i]).compare("--socket") == 0 ||
+			string(argv[i]).compare("--fingerprint") == 0 || string(argv[i]).compare("--list") == 0)
+			banner = false;
+
+		// A tar stream written to stdout must not be mixed with any
+		// message. The stream gets its own descriptor and everything else
+		// printed to stdout goes to stderr.
+		if (string(argv[i]).compare("--tar") == 0 && i + 1 < argc && string(argv[i+1]).compare("-") == 0 && tarFd < 0)
+		{
+			tarFd = dup(STDOUT_FILENO);
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+		}
+
+		if (string(argv[i]).compare("--cat") == 0 && catFd < 0 && tarFd < 0)
+		{
+			catFd = dup(STDOUT_FILENO);
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+		}
+	}
+
+	if (banner)
+		version();
 
 	outdir.assign(".");
 	argc--;
@@ -88,10 +154,313 @@ int main (int argc, char **argv)
 		}
 
 		if (par.compare("-t") == 0 || par.compare("--transfer") == 0)
-			transfer = true;
+			options.transfer = true;
 
 		if (par.compare("-v") == 0 || par.compare("--verbose") == 0)
-			verbose = true;
+			options.verbose = true;
+
+		if (par.compare("-w") == 0 || par.compare("--writer") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+
+				if (!reader::OutputWriter::typeFromString(*argv, writerType))
+				{
+					cerr << "Unknown writer " << *argv << "!" << endl << endl;
+					usage();
+					return 1;
+				}
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--stats") == 0)
+			stats = true;
+
+		if (par.compare("--verify") == 0)
+			verifyMode = true;
+
+		if (par.compare("--diff") == 0)
+		{
+			if (argc > 2)
+			{
+				diffA.assign(*(argv+1));
+				diffB.assign(*(argv+2));
+				argc -= 2;
+				argv += 2;
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--content") == 0)
+			contentDiff = true;
+
+		if (par.compare("-j") == 0 || par.compare("--threads") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+				threads = atoi(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--scan") == 0)
+			options.scan = true;
+
+		if (par.compare("--watch") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+				watchDir.assign(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--trace") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+				traceFile.assign(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--analyze") == 0)
+			analyzeMode = true;
+
+		if (par.compare("--cat") == 0 || par.compare("--chain-index") == 0 ||
+			par.compare("--offset") == 0 || par.compare("--length") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+
+				if (par.compare("--cat") == 0)
+					catEntry.assign(*argv);
+				else if (par.compare("--chain-index") == 0)
+					chainIndex.assign(*argv);
+				else if (par.compare("--offset") == 0)
+					catOffset = strtoull(*argv, nullptr, 10);
+				else
+					catLength = strtoull(*argv, nullptr, 10);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--serve") == 0 || par.compare("--socket") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+
+				if (par.compare("--serve") == 0)
+					serveSocket.assign(*argv);
+				else
+					clientSocket.assign(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--cache") == 0 || par.compare("--cache-size") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+
+				if (par.compare("--cache") == 0)
+					cacheDir.assign(*argv);
+				else
+					cacheSize = atoi(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--fingerprint") == 0)
+			fingerprintMode = true;
+
+		if (par.compare("--strong") == 0)
+			strongFingerprint = true;
+
+		if (par.compare("--list") == 0)
+			listMode = true;
+
+		if (par.compare("--stop") == 0)
+			stopMode = true;
+
+		if (par.compare("--defrag") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+				defragFile.assign(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--transcode") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+				transcodeFile.assign(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--to") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+
+				if (!reader::Transcode::codingFromString(*argv, transcodeTo))
+				{
+					cerr << "Unknown format " << *argv << "!" << endl << endl;
+					usage();
+					return 1;
+				}
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--xml-index") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+				xmlIndex.assign(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--tar") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+				tarFile.assign(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("-i") == 0 || par.compare("--include") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+				filter.addInclude(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("-x") == 0 || par.compare("--exclude") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+				filter.addExclude(*argv);
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
+		if (par.compare("--type") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+
+				if (!filter.addTypes(*argv))
+				{
+					cout << endl;
+					usage();
+					return 1;
+				}
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
 
 		if (par.compare("-h") == 0 || par.compare("--help") == 0)
 		{
@@ -101,18 +470,37 @@ int main (int argc, char **argv)
 
 		if (par.compare("-a") == 0 || par.compare("--alternate") == 0)
 		{
-			password = "6Brzh63P3wlAkTtl";
-			salt = "M0rPh3u5";
+			options.password = ALTERNATE_PASSWORD;
+			options.salt = ALTERNATE_SALT;
 			cout << "Using alternate password and salt." << endl << endl;
 		}
 
+		if (par.compare("-k") == 0 || par.compare("--auto-key") == 0)
+			autoKey = true;
+
+		if (par.compare("--keyring") == 0)
+		{
+			if (argc > 1)
+			{
+				argc--;
+				argv++;
+				keyring.assign(*argv);
+				autoKey = true;
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+
 		if (par.compare("-p") == 0 || par.compare("--password") == 0)
 		{
 			if (argc > 1)
 			{
 				argc--;
 				argv++;
-				password.assign(*argv);
+				options.password.assign(*argv);
 				cout << "Using individual password." << endl << endl;
 			}
 			else
@@ -128,7 +516,7 @@ int main (int argc, char **argv)
 			{
 				argc--;
 				argv++;
-				salt.assign(*argv);
+				options.salt.assign(*argv);
 				cout << "Using individual salt." << endl << endl;
 			}
 			else
@@ -142,31 +530,226 @@ int main (int argc, char **argv)
 		argv++;
 	}
 
-	if (fname.length() == 0)
+	if (fname.length() == 0 && diffA.length() == 0 && serveSocket.empty() && watchDir.empty() && !stopMode)
 	{
 		cerr << "Missing file name to read from." << endl << endl;
 		usage();
 		exit (1);
 	}
 
-	if (password.length() != 16)
+	if (options.password.length() != 16)
 	{
-		cerr << "Password has wrong length of " << password.length() << " characters! Should be 16 characters long." << endl << endl;;
+		cerr << "Password has wrong length of " << options.password.length() << " characters! Should be 16 characters long." << endl << endl;;
 		usage();
 		return 1;
 	}
 
-	if (salt.length() != 8)
+	if (options.salt.length() != 8)
 	{
-		cerr << "Salt has wrong length of " << salt.length() << " characters! Should be 8 characters long." << endl << endl;
+		cerr << "Salt has wrong length of " << options.salt.length() << " characters! Should be 8 characters long." << endl << endl;
 		usage();
 		return 1;
 	}
 
-	if (outdir.length() > 0 && !fs::exists(outdir))
+	// The events of a trace are kept in memory until the program returns
+	// from here, which a server or a watch usually doesn't.
+	if (!traceFile.empty() && (!serveSocket.empty() || !watchDir.empty()))
+	{
+		cerr << "The option --trace can't be used together with --serve or --watch!" << endl << endl;
+		usage();
+		return 1;
+	}
+
+	// The trace is written when the program returns from here.
+	unique_ptr<reader::Trace> trace;
+
+	if (!traceFile.empty())
+	{
+		trace.reset(new reader::Trace(traceFile));
+		options.trace = trace.get();
+	}
+
+	if (!serveSocket.empty())
+	{
+		reader::Server server(serveSocket, options);
+		return server.serve() ? 0 : 2;
+	}
+
+	if (!watchDir.empty())
+	{
+		reader::Watch watch(watchDir, outdir, options);
+		watch.setWriter(writerType);
+		watch.setThreads(threads);
+		return watch.doWatch() ? 0 : 2;
+	}
+
+	// As a client the request is sent to the server. The paths are made
+	// absolute because the server runs in another directory.
+	if (!clientSocket.empty())
+	{
+		vector<string> fields;
+
+		if (stopMode)
+			fields = {"STOP"};
+		else if (listMode)
+			fields = {"LIST", fs::absolute(fname).string()};
+		else if (!catEntry.empty())
+			fields = {"CAT", fs::absolute(fname).string(), catEntry};
+		else
+			fields = {"EXTRACT", fs::absolute(fname).string(), fs::absolute(outdir).string(), options.transfer ? "1" : "0"};
+
+		return reader::Server::request(clientSocket, fields, catFd >= 0 ? catFd : STDOUT_FILENO);
+	}
+
+	// The key is found before any file is opened with the options.
+	if (autoKey && !fname.empty())
+	{
+		reader::KeyProbe probe(fname, options);
+
+		if ((!keyring.empty() && !probe.loadKeyring(keyring)) || !probe.detect(options))
+			return 2;
+	}
+
+	if (fingerprintMode)
+	{
+		reader::Fingerprint fingerprint(fname, options);
+		fingerprint.setStrong(strongFingerprint);
+		fingerprint.setThreads(threads);
+		return fingerprint.doFingerprint() ? 0 : 2;
+	}
+
+	if (listMode)
+	{
+		reader::Archive archive(fname, options);
+
+		if (!filter.empty())
+			archive.setFilter(&filter);
+
+		if (!archive.open() || !archive.readIndex())
+			return 2;
+
+		cout << reader::Server::listEntries(archive);
+		return 0;
+	}
+
+	if (diffA.length() > 0)
+	{
+		reader::Diff diff(diffA, diffB, options);
+		diff.setThreads(threads);
+		diff.setContent(contentDiff);
+		return diff.doDiff();
+	}
+
+	if (transcodeFile.length() > 0)
+	{
+		if (transcodeTo == reader::CODING_PLAIN)
+		{
+			cerr << "Missing target format (--to tp4|tp5)." << endl << endl;
+			usage();
+			return 1;
+		}
+
+		reader::Transcode transcode(fname, transcodeFile, options);
+		transcode.setCoding(transcodeTo);
+		transcode.setThreads(threads);
+		return transcode.doTranscode() ? 0 : 2;
+	}
+
+	if (defragFile.length() > 0)
+	{
+		reader::Transcode defrag(fname, defragFile, options);
+		defrag.setCoding(reader::CODING_PLAIN);
+		return defrag.doTranscode() ? 0 : 2;
+	}
+
+	if (!catEntry.empty())
+	{
+		reader::Archive archive(fname, options);
+
+		if (!archive.open() || !archive.readIndex())
+			return 2;
+
+		const reader::USAGE_BLOCK *ub = archive.findEntry(catEntry);
+
+		if (!ub)
+		{
+			cerr << "The file " << catEntry << " is not part of " << fname << "!" << endl;
+			return 2;
+		}
+
+		// The whole file is decoded while it is read. Nothing more than a
+		// block and a buffer is kept in memory.
+		if (catOffset == 0 && catLength == SIZE_MAX && chainIndex.empty())
+		{
+			reader::EntryStream in(archive, ub);
+			char buf[CHUNK];
+
+			while (in.read(buf, sizeof(buf)) || in.gcount() > 0)
+			{
+				if (!reader::OutputDir::writeAll(catFd, buf, in.gcount()))
+					return 2;
+			}
+
+			return in.failed() ? 2 : 0;
+		}
+
+		// A saved chain index is used if it belongs to the entry. Otherwise
+		// it is built and saved for the next time.
+		reader::ChainIndex chain(archive, ub);
+
+		if (chainIndex.empty() || !chain.load(chainIndex))
+		{
+			if (!chain.build() || (!chainIndex.empty() && !chain.save(chainIndex)))
+				return 2;
+		}
+
+		string data;
+
+		if (!chain.read(catOffset, catLength, data) || !reader::OutputDir::writeAll(catFd, data.data(), data.length()))
+			return 2;
+
+		return 0;
+	}
+
+	if (analyzeMode)
+	{
+		reader::Analyze analyze(fname, options);
+		analyze.setThreads(threads);
+		return analyze.doAnalyze() ? 0 : 2;
+	}
+
+	if (verifyMode)
+	{
+		reader::Verify verify(fname, options);
+		verify.setThreads(threads);
+		return verify.doVerify() ? 0 : 2;
+	}
+
+	if (tarFile.empty() && outdir.length() > 0 && !fs::exists(outdir))
 		fs::create_directories(outdir);
 
-	reader::ReadTP4 readtp4(fname, outdir);
+	unique_ptr<reader::DecodeCache> cache;
+
+	if (!cacheDir.empty())
+	{
+		cache.reset(new reader::DecodeCache(cacheDir, cacheSize));
+
+		if (!cache->open())
+			return 2;
+	}
+
+	reader::ReadTP4 readtp4(fname, outdir, options);
+	readtp4.setCache(cache.get());
+	readtp4.setWriter(writerType);
+	readtp4.setStats(stats);
+	readtp4.setFilter(&filter);
+	readtp4.setThreads(threads);
+
+	if (!xmlIndex.empty())
+		readtp4.setXmlIndex(xmlIndex);
+
+	if (!tarFile.empty())
+		readtp4.setTar(tarFile, tarFd);
 
 	if (!readtp4.doRead())
 		return 2;
@@ -193,6 +776,89 @@ void usage()
 	cout << "\t--password <password>" << endl << endl;
 	cout << "\t-s <salt>          Use individual salt to decrypt TP5 file." << endl;
 	cout << "\t--salt <salt>" << endl << endl;
+	cout << "\t-k                 Find the password and salt of a TP5 file. The given, the" << endl;
+	cout << "\t--auto-key         default and the alternate ones are tried on the first" << endl;
+	cout << "\t                   blocks of a small encrypted file." << endl << endl;
+	cout << "\t--keyring <file>   Like --auto-key, but the lines of <file> with a password" << endl;
+	cout << "\t                   and a salt separated by a blank are tried too." << endl << endl;
+	cout << "\t-w <writer>        Selects how the output files are written. Possible values" << endl;
+	cout << "\t--writer <writer>  are \"buffered\" (default), \"prealloc\" (fallocate + pwrite)," << endl;
+	cout << "\t                   \"mmap\" (ftruncate + mmap) and \"tmpfile\" (O_TMPFILE +" << endl;
+	cout << "\t                   linkat; files appear only when they are complete)." << endl << endl;
+	cout << "\t--watch <dir>      Watch the directory <dir> and extract every TP4 or TP5" << endl;
+	cout << "\t                   file saved into it into a directory of the same name" << endl;
+	cout << "\t                   below the output directory. Only changed files are" << endl;
+	cout << "\t                   written again." << endl << endl;
+	cout << "\t--trace <file>     Write the time of every phase (index, read, decode," << endl;
+	cout << "\t                   write) of every file as Chrome trace events into <file>." << endl;
+	cout << "\t                   Not together with --serve or --watch." << endl << endl;
+	cout << "\t--scan             Rebuild the index from all blocks read in parallel" << endl;
+	cout << "\t                   instead of following the index. Recovers the files of" << endl;
+	cout << "\t                   damaged archives; --defrag writes a repaired copy." << endl << endl;
+	cout << "\t--analyze          Print a report about the fragmentation of the chains," << endl;
+	cout << "\t                   the unused blocks and the sizes and types of the files." << endl << endl;
+	cout << "\t--defrag <file>    Write a copy of the file into <file> where every chain" << endl;
+	cout << "\t                   is stored in consecutive blocks behind the index and" << endl;
+	cout << "\t                   all unused blocks are dropped." << endl << endl;
+	cout << "\t--cat <name>       Write the bytes of the file <name> to stdout. All" << endl;
+	cout << "\t                   messages go to stderr. The file is decoded while its" << endl;
+	cout << "\t                   blocks are read. With --offset or --length only the" << endl;
+	cout << "\t                   blocks containing the range are read." << endl << endl;
+	cout << "\t--offset <n>       Together with --cat: First byte to write (default 0)." << endl << endl;
+	cout << "\t--length <n>       Together with --cat: Number of bytes to write (default" << endl;
+	cout << "\t                   all up to the end of the file)." << endl << endl;
+	cout << "\t--chain-index <f>  Together with --cat: Load the table of blocks and gzip" << endl;
+	cout << "\t                   checkpoints of the file from <f>. If <f> doesn't exist" << endl;
+	cout << "\t                   or belongs to another file, it is built and saved." << endl << endl;
+	cout << "\t--cache <dir>      Keep decoded files in the directory <dir> and take them" << endl;
+	cout << "\t                   from there when the same data is extracted again." << endl << endl;
+	cout << "\t--cache-size <MiB> Size limit of the cache (default 1024). The least" << endl;
+	cout << "\t                   recently used files are removed." << endl << endl;
+	cout << "\t--fingerprint      Print a digest of the header and the index. It changes" << endl;
+	cout << "\t                   when a file in the archive was changed. No data is read." << endl << endl;
+	cout << "\t--strong           Together with --fingerprint: Hash the first and the last" << endl;
+	cout << "\t                   block of every file too." << endl << endl;
+	cout << "\t--list             Print size, modification time and path of every file." << endl << endl;
+	cout << "\t--serve <socket>   Run as server on the Unix domain socket <socket>. Open" << endl;
+	cout << "\t                   archives, their index and decoded files are kept in" << endl;
+	cout << "\t                   memory between the requests." << endl << endl;
+	cout << "\t--socket <socket>  Send the request to the server at <socket> instead of" << endl;
+	cout << "\t                   doing it here. Works with -f, -d, -t, --list and --cat." << endl << endl;
+	cout << "\t--stop             Together with --socket: Stop the server." << endl << endl;
+	cout << "\t--transcode <file> Convert the file into the new FSF file <file> instead of" << endl;
+	cout << "\t                   extracting it. All XML files are converted into the" << endl;
+	cout << "\t                   format given with --to. All other files are copied." << endl << endl;
+	cout << "\t--to <format>      Together with --transcode: \"tp4\" compresses the XML" << endl;
+	cout << "\t                   files with gzip, \"tp5\" encrypts them with AES." << endl << endl;
+	cout << "\t--xml-index <name> Scan the XML files while they are extracted and write" << endl;
+	cout << "\t                   an index of the pages, popups, buttons and the images," << endl;
+	cout << "\t                   sounds and fonts they use as JSON file <name>." << endl << endl;
+	cout << "\t--tar <file>       Write all files as one tar archive into <file> instead" << endl;
+	cout << "\t                   of the directory. If <file> is \"-\" the archive is written" << endl;
+	cout << "\t                   to stdout and all messages go to stderr." << endl << endl;
+	cout << "\t--stats            Print the number of written files and bytes and the" << endl;
+	cout << "\t                   throughput of the writer at the end." << endl << endl;
+	cout << "\t--verify           Check the integrity of the file instead of extracting it." << endl;
+	cout << "\t                   All block chains are checked in parallel for cycles," << endl;
+	cout << "\t                   cross-linked blocks and wrong sizes. Compressed and" << endl;
+	cout << "\t                   encrypted files are decoded in memory to test them." << endl;
+	cout << "\t                   The exit code is 2 if an error was found." << endl << endl;
+	cout << "\t--diff <a> <b>     Compare the files <a> and <b> and print the added (A)," << endl;
+	cout << "\t                   removed (D) and modified (M) files, one per line:" << endl;
+	cout << "\t                   state<TAB>size a<TAB>size b<TAB>reason<TAB>path" << endl;
+	cout << "\t                   The exit code is 0 if the files are equal, 1 if they" << endl;
+	cout << "\t                   differ and 2 on error." << endl << endl;
+	cout << "\t--content          Together with --diff: Decode compressed and encrypted" << endl;
+	cout << "\t                   files and compare their content instead of the raw data." << endl << endl;
+	cout << "\t-i <glob>          Extract only files whose path matches the shell pattern" << endl;
+	cout << "\t--include <glob>   <glob>. May be given more than once." << endl << endl;
+	cout << "\t-x <glob>          Don't extract files whose path matches the shell pattern" << endl;
+	cout << "\t--exclude <glob>   <glob>. May be given more than once." << endl << endl;
+	cout << "\t--type <list>      Extract only files of the given types. <list> is a comma" << endl;
+	cout << "\t                   separated list of \"xml\", \"image\", \"sound\", \"font\"" << endl;
+	cout << "\t                   and \"other\". The manifest lists only extracted files." << endl << endl;
+	cout << "\t-j <num>           Number of threads to use for parallel work. Default is" << endl;
+	cout << "\t--threads <num>    the number of CPU cores." << endl << endl;
 	cout << "\t-v                 Verbose; Thismakes the program very noisy. The program shows" << endl;
 	cout << "\t--verbose          how it reads the internal block structure." << endl << endl;
 	cout << "\t-h --help          This help." << endl << endl;
@@ -24,9 +24,5 @@
 #define VERSION     "2.1.0"
 
 extern std::string prgName;
-extern bool verbose;
-extern bool transfer;
-extern std::string password;
-extern std::string salt;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+
+#include "hash.h"
+#include "blockview.h"
+
+using namespace reader;
+using namespace std;
+
+#define PRIME64_1	11400714785074694791ULL
+#define PRIME64_2	14029467366897019727ULL
+#define PRIME64_3	1609587929392839161ULL
+#define PRIME64_4	9650029242287828579ULL
+#define PRIME64_5	2870177450012600261ULL
+
+namespace
+{
+	inline uint64_t rotl64(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t read64(const unsigned char *p)
+	{
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		v = __builtin_bswap64(v);
+#endif
+		return v;
+	}
+
+	inline uint64_t round64(uint64_t acc, uint64_t input)
+	{
+		acc += input * PRIME64_2;
+		acc = rotl64(acc, 31);
+		return acc * PRIME64_1;
+	}
+
+	inline uint64_t mergeRound(uint64_t acc, uint64_t val)
+	{
+		acc ^= round64(0, val);
+		return acc * PRIME64_1 + PRIME64_4;
+	}
+}
+
+Hash64::Hash64(uint64_t seed)
+{
+	reset(seed);
+}
+
+void Hash64::reset(uint64_t seed)
+{
+	mSeed = seed;
+	v1 = seed + PRIME64_1 + PRIME64_2;
+	v2 = seed + PRIME64_2;
+	v3 = seed;
+	v4 = seed - PRIME64_1;
+	totalLen = 0;
+	fill = 0;
+}
+
+void Hash64::update(const void *data, size_t len)
+{
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	totalLen += len;
+
+	if (fill + len < 32)
+	{
+		if (len)
+			memcpy(buffer + fill, p, len);
+
+		fill += len;
+		return;
+	}
+
+	if (fill)
+	{
+		size_t n = 32 - fill;
+		memcpy(buffer + fill, p, n);
+		v1 = round64(v1, read64(buffer));
+		v2 = round64(v2, read64(buffer + 8));
+		v3 = round64(v3, read64(buffer + 16));
+		v4 = round64(v4, read64(buffer + 24));
+		p += n;
+		len -= n;
+		fill = 0;
+	}
+
+	while (len >= 32)
+	{
+		v1 = round64(v1, read64(p));
+		v2 = round64(v2, read64(p + 8));
+		v3 = round64(v3, read64(p + 16));
+		v4 = round64(v4, read64(p + 24));
+		p += 32;
+		len -= 32;
+	}
+
+	if (len)
+		memcpy(buffer, p, len);
+
+	fill = len;
+}
+
+/*
+ * Adds a 32 bit number in little endian byte order. Used to hash the fields
+ * of the index independent of the byte order of the host.
+ */
+void Hash64::update32(uint32_t value)
+{
+	unsigned char buf[4];
+	storeLE32(buf, value);
+	update(buf, sizeof(buf));
+}
+
+uint64_t Hash64::digest() const
+{
+	uint64_t h;
+
+	if (totalLen >= 32)
+	{
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = mergeRound(h, v1);
+		h = mergeRound(h, v2);
+		h = mergeRound(h, v3);
+		h = mergeRound(h, v4);
+	}
+	else
+		h = mSeed + PRIME64_5;
+
+	h += totalLen;
+	const unsigned char *p = buffer;
+	size_t len = fill;
+
+	while (len >= 8)
+	{
+		h ^= round64(0, read64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+		len -= 8;
+	}
+
+	if (len >= 4)
+	{
+		h ^= static_cast<uint64_t>(loadLE32(p)) * PRIME64_1;
+		h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+		len -= 4;
+	}
+
+	while (len > 0)
+	{
+		h ^= (*p) * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+		p++;
+		len--;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t Hash64::hash(const void *data, size_t len, uint64_t seed)
+{
+	Hash64 h(seed);
+	h.update(data, len);
+	return h.digest();
+}
+
+string Hash64::toString(uint64_t hash)
+{
+	stringstream s;
+	s << setfill('0') << setw(16) << hex << hash;
+	return s.str();
+}
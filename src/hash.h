@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace reader
+{
+	/**
+	 * A fast non cryptographic 64 bit hash (XXH64). The data may be added
+	 * in pieces of any size with update(). The result is the same as if
+	 * all data would have been added at once.
+	 */
+	class Hash64
+	{
+		public:
+			explicit Hash64(uint64_t seed = 0);
+
+			void reset(uint64_t seed = 0);
+			void update(const void *data, size_t len);
+			void update(const std::string& str) { update(str.data(), str.length()); }
+			void update32(uint32_t value);
+			uint64_t digest() const;
+
+			static uint64_t hash(const void *data, size_t len, uint64_t seed = 0);
+			static std::string toString(uint64_t hash);
+
+		private:
+			uint64_t v1, v2, v3, v4;
+			uint64_t mSeed;
+			uint64_t totalLen{0};
+			unsigned char buffer[32];
+			size_t fill{0};
+	};
+}
+
+#endif
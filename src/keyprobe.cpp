@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "keyprobe.h"
+#include "filter.h"
+
+using namespace reader;
+using namespace std;
+
+KeyProbe::KeyProbe(const string& fn, const OPTIONS& opts)
+	: archive{fn, opts}
+{
+	// The given password and salt are named after a built-in one if equal.
+	if (opts.password == DEFAULT_PASSWORD && opts.salt == DEFAULT_SALT)
+		addCandidate("default", opts.password, opts.salt);
+	else if (opts.password == ALTERNATE_PASSWORD && opts.salt == ALTERNATE_SALT)
+		addCandidate("alternate", opts.password, opts.salt);
+	else
+		addCandidate("given", opts.password, opts.salt);
+
+	addCandidate("default", DEFAULT_PASSWORD, DEFAULT_SALT);
+	addCandidate("alternate", ALTERNATE_PASSWORD, ALTERNATE_SALT);
+}
+
+/*
+ * Reads further candidates from \p file. Every line holds a password and
+ * a salt separated by white space. Empty lines and lines starting with
+ * '#' are ignored.
+ */
+bool KeyProbe::loadKeyring(const string& file)
+{
+	ifstream in(file);
+
+	if (!in)
+	{
+		cerr << "Error opening keyring " << file << "!" << endl;
+		return false;
+	}
+
+	string line;
+	size_t num = 0;
+
+	while (getline(in, line))
+	{
+		num++;
+		istringstream fields(line);
+		string password, salt, rest;
+
+		if (!(fields >> password) || password[0] == '#')
+			continue;
+
+		if (!(fields >> salt) || (fields >> rest) || password.length() != 16 || salt.length() != 8)
+		{
+			cerr << file << ":" << num << ": Expecting a password of 16 and a salt of 8 characters!" << endl;
+			return false;
+		}
+
+		addCandidate(file + ":" + to_string(num), password, salt);
+	}
+
+	return true;
+}
+
+void KeyProbe::addCandidate(const string& name, const string& password, const string& salt)
+{
+	for (auto itr = candidates.begin(); itr != candidates.end(); ++itr)
+	{
+		if (itr->password == password && itr->salt == salt)
+			return;
+	}
+
+	CANDIDATE cand;
+	cand.name = name;
+	cand.password = password;
+	cand.salt = salt;
+	candidates.push_back(move(cand));
+}
+
+/*
+ * Sets the password and the salt of \p opts to the first candidate
+ * decrypting the sample. If the file has no encrypted entry, \p opts is
+ * not changed. Returns FALSE if no candidate fits.
+ */
+bool KeyProbe::detect(OPTIONS& opts)
+{
+	if (!archive.open() || !archive.readIndex())
+		return false;
+
+	string sample;
+
+	if (!readSample(sample))
+		return false;
+
+	if (sample.empty())
+	{
+		cerr << "The file " << archive.getFileName() << " has no encrypted entries." << endl;
+		return true;
+	}
+
+	for (auto itr = candidates.begin(); itr != candidates.end(); ++itr)
+	{
+		if (opts.verbose)
+			cerr << "Trying " << itr->name << " password and salt ..." << endl;
+
+		if (tryKey(*itr, sample))
+		{
+			opts.password = itr->password;
+			opts.salt = itr->salt;
+			cerr << "Using " << itr->name << " password and salt." << endl;
+			return true;
+		}
+	}
+
+	cerr << "None of " << candidates.size() << " passwords and salts decrypts " << archive.getFileName() << "!" << endl;
+	return false;
+}
+
+/*
+ * Reads the first block of the smallest encrypted entry and returns the
+ * AES blocks at its start. \p sample stays empty if there is none.
+ * The XML entries are sorted by size from the index, so usually only one
+ * block is read.
+ */
+bool KeyProbe::readSample(string& sample)
+{
+	unsigned char memblock[SIZE_BLOCK] = {0};
+	BlockView block(memblock);
+	vector<const struct USAGE_BLOCK *> xmls;
+	const vector<struct INDEX *>& entries = archive.getEntries();
+
+	sample.clear();
+
+	for (auto itr = entries.begin(); itr != entries.end(); ++itr)
+	{
+		const struct USAGE_BLOCK *ub = (*itr)->ublock;
+
+		if (EntryFilter::entryType(ub->filePath) == TYPE_XML && ub->sizeBytes >= AES128_KEY_SIZE && ub->sizeBytes % AES128_KEY_SIZE == 0)
+			xmls.push_back(ub);
+	}
+
+	sort(xmls.begin(), xmls.end(), [](const struct USAGE_BLOCK *a, const struct USAGE_BLOCK *b) { return a->sizeBytes < b->sizeBytes; });
+
+	for (auto itr = xmls.begin(); itr != xmls.end(); ++itr)
+	{
+		if (!archive.readBlock((*itr)->startBlock, memblock))
+			return false;
+
+		ByteSpan payload = block.payload();
+
+		if (Archive::detectCoding((*itr)->filePath, payload.data, payload.size) != CODING_AES)
+			continue;
+
+		size_t len = min(payload.size - payload.size % AES128_KEY_SIZE, (size_t)PROBE_CIPHER_BLOCKS * AES128_KEY_SIZE);
+		sample.assign(payload.chars(), len);
+		break;
+	}
+
+	return true;
+}
+
+/*
+ * Decrypts the sample with the key of \p cand. With padding enabled the
+ * last block is held back, so only complete blocks before it are
+ * returned. They are enough to see the prolog.
+ */
+bool KeyProbe::tryKey(CANDIDATE& cand, const string& sample)
+{
+	string text;
+	cand.aes.reset(new Scramble);
+	cand.aes->setQuiet(true);
+
+	if (!cand.aes->aesInit(cand.password, cand.salt) ||
+			!cand.aes->aesDecodeUpdate(reinterpret_cast<const unsigned char *>(sample.data()), sample.length(), text))
+		return false;
+
+	// A single block is decrypted by the final call. Its padding is
+	// checked then, which is a test as well.
+	if (text.empty() && !cand.aes->aesDecodeFinal(text))
+		return false;
+
+	return isProlog(text);
+}
+
+/*
+ * TRUE if \p text starts with an XML declaration. A byte order mark and
+ * white space in front of it are skipped.
+ */
+bool KeyProbe::isProlog(const string& text)
+{
+	size_t pos = 0;
+
+	if (text.compare(0, 3, "\xef\xbb\xbf") == 0)
+		pos = 3;
+
+	while (pos < text.length() && isspace((unsigned char)text[pos]))
+		pos++;
+
+	return text.compare(pos, 5, "<?xml") == 0;
+}
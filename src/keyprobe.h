@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __KEYPROBE_H__
+#define __KEYPROBE_H__
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "archive.h"
+#include "scramble.h"
+
+#define PROBE_CIPHER_BLOCKS	3		// AES blocks given to a candidate; the last one is held back
+
+namespace reader
+{
+	/**
+	 * Finds the password and the salt of a TP5 file. Every candidate gets
+	 * the first AES blocks of the smallest encrypted entry only. If they
+	 * decrypt to an XML prolog, the candidate is taken. No entry is ever
+	 * decrypted completely with a wrong key.
+	 *
+	 * The candidates are the password and salt given on the command line,
+	 * the default and the alternate one and those of a keyring file. Each
+	 * one is tried once; a candidate equal to one before is dropped, so no
+	 * key is derived twice.
+	 */
+	class KeyProbe
+	{
+		struct CANDIDATE
+		{
+			std::string name;
+			std::string password;
+			std::string salt;
+			std::unique_ptr<Scramble> aes;		// Holds the derived key and IV
+		};
+
+		Archive archive;
+		std::vector<CANDIDATE> candidates;
+
+		public:
+			explicit KeyProbe(const std::string& fn, const OPTIONS& opts = OPTIONS());
+
+			bool loadKeyring(const std::string& file);
+			bool detect(OPTIONS& opts);
+
+		private:
+			void addCandidate(const std::string& name, const std::string& password, const std::string& salt);
+			bool readSample(std::string& sample);
+			bool tryKey(CANDIDATE& cand, const std::string& sample);
+			static bool isProlog(const std::string& text);
+	};
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+#ifndef __OPTIONS_H__
+#define __OPTIONS_H__
+
+#include <string>
+
+#define DEFAULT_PASSWORD	"8P0puxB5OVUFI6uX"
+#define DEFAULT_SALT		"MarkRobs"
+#define ALTERNATE_PASSWORD	"6Brzh63P3wlAkTtl"		// Used by TPControl
+#define ALTERNATE_SALT		"M0rPh3u5"
+
+namespace reader
+{
+	class Trace;
+
+	/**
+	 * The settings used to read a file. Every object working on a file
+	 * (Archive, ReadTP4, Verify, Diff, Transcode, Analyze) gets its own copy
+	 * when it is created. There is no global state, so several files can be
+	 * processed at the same time in one process, each with its own password
+	 * and salt.
+	 *
+	 * Thread safety: Different objects may be used by different threads at
+	 * the same time. One object must be used by one thread only. The
+	 * exception is Archive: Once the index was read, readBlock(),
+	 * readBlocks(), readChain(), decode() and encode() may be called by
+	 * several threads at the same time.
+	 *
+	 * The Trace is shared by all copies. It is owned by the caller and
+	 * must live longer than the objects using it.
+	 */
+	struct OPTIONS
+	{
+		bool verbose{false};			// Print the block structure while reading
+		bool transfer{false};			// Sort the files into images, sounds and fonts
+		bool scan{false};				// Rebuild the index from a scan of all blocks
+		std::string password{DEFAULT_PASSWORD};
+		std::string salt{DEFAULT_SALT};
+		Trace *trace{nullptr};			// Records the phases of the run if not nullptr
+	};
+}
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "outdir.h"
+
+using namespace reader;
+using namespace std;
+
+OutputDir::~OutputDir()
+{
+	close();
+}
+
+bool OutputDir::open()
+{
+	if (rootFd >= 0)
+		return true;
+
+	rootFd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (rootFd < 0)
+	{
+		cerr << "Error opening directory " << root << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	dirs.insert(pair<string, int>("", rootFd));
+	return true;
+}
+
+void OutputDir::close()
+{
+	for (auto itr = dirs.begin(); itr != dirs.end(); ++itr)
+		::close(itr->second);
+
+	dirs.clear();
+	rootFd = -1;
+}
+
+/*
+ * Returns the file descriptor of the directory \p dir relative to the root
+ * directory. If the directory was not opened before, it is created if
+ * necessary and opened. Every directory is opened only once.
+ */
+int OutputDir::dirFd(const string& dir)
+{
+	size_t start = dir.find_first_not_of("/");
+	size_t end = dir.find_last_not_of("/");
+	string d;
+
+	if (start != string::npos)
+		d = dir.substr(start, end - start + 1);
+
+	auto itr = dirs.find(d);
+
+	if (itr != dirs.end())
+		return itr->second;
+
+	if (rootFd < 0 && !open())
+		return -1;
+
+	if (d.empty())
+		return rootFd;
+
+	int parent = rootFd;
+	string base = d;
+	size_t pos = d.find_last_of("/");
+
+	if (pos != string::npos)
+	{
+		parent = dirFd(d.substr(0, pos));
+		base = d.substr(pos + 1);
+
+		if (parent < 0)
+			return -1;
+	}
+
+	if (mkdirat(parent, base.c_str(), 0777) != 0 && errno != EEXIST)
+	{
+		cerr << "Error creating directory " << root << "/" << d << ": " << strerror(errno) << endl;
+		return -1;
+	}
+
+	int fd = openat(parent, base.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		cerr << "Error opening directory " << root << "/" << d << ": " << strerror(errno) << endl;
+		return -1;
+	}
+
+	dirs.insert(pair<string, int>(d, fd));
+	return fd;
+}
+
+/*
+ * Returns the file descriptor of the directory where the file \p name
+ * relative to \p dir is located. \p name may contain subdirectories. The
+ * bare file name is returned in \p base.
+ */
+int OutputDir::parentFd(const string& dir, const string& name, string& base)
+{
+	size_t pos = name.find_last_of("/");
+
+	if (pos != string::npos)
+	{
+		base = name.substr(pos + 1);
+		return dirFd(dir + "/" + name.substr(0, pos));
+	}
+
+	base = name;
+	return dirFd(dir);
+}
+
+/*
+ * Creates (or truncates) the file \p name in the directory \p dir and
+ * returns an open file descriptor for writing. If \p readWrite is TRUE,
+ * the file is opened for reading too (needed for a shared mapping). The
+ * caller must close it.
+ */
+int OutputDir::createFile(const string& dir, const string& name, bool readWrite)
+{
+	string base;
+	int dfd = parentFd(dir, name, base);
+
+	if (dfd < 0)
+		return -1;
+
+	int fd = openat(dfd, base.c_str(), (readWrite ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+	if (fd < 0)
+		cerr << "Error creating file " << path(dir, name) << ": " << strerror(errno) << endl;
+
+	return fd;
+}
+
+bool OutputDir::writeFile(const string& dir, const string& name, const char *buf, size_t len)
+{
+	int fd = createFile(dir, name);
+
+	if (fd < 0)
+		return false;
+
+	bool ret = writeAll(fd, buf, len);
+
+	if (!ret)
+		cerr << "Error writing to file " << path(dir, name) << ": " << strerror(errno) << endl;
+
+	::close(fd);
+	return ret;
+}
+
+string OutputDir::path(const string& dir, const string& name)
+{
+	if (dir.empty())
+		return root + "/" + name;
+
+	if (dir[0] == '/')
+		return root + dir + "/" + name;
+
+	return root + "/" + dir + "/" + name;
+}
+
+bool OutputDir::writeAll(int fd, const char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t w = ::write(fd, buf, len);
+
+		if (w < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		buf += w;
+		len -= w;
+	}
+
+	return true;
+}
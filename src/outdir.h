@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __OUTDIR_H__
+#define __OUTDIR_H__
+
+#include <string>
+#include <map>
+
+namespace reader
+{
+	/**
+	 * The output directory. The target directory and every subdirectory
+	 * below it are opened only once. Their file descriptors are cached and
+	 * all files are created relative to them with openat(). This avoids
+	 * resolving the full path of every written file again.
+	 */
+	class OutputDir
+	{
+		std::string root{"."};
+		int rootFd{-1};
+		std::map<std::string, int> dirs;	// Relative directory --> open file descriptor
+
+		public:
+			explicit OutputDir(const std::string& r)
+				: root{r}
+			{}
+
+			~OutputDir();
+
+			bool open();
+			void close();
+			int dirFd(const std::string& dir);
+			int parentFd(const std::string& dir, const std::string& name, std::string& base);
+			int createFile(const std::string& dir, const std::string& name, bool readWrite=false);
+			bool writeFile(const std::string& dir, const std::string& name, const char *buf, size_t len);
+			std::string path(const std::string& dir, const std::string& name);
+			const std::string& getRoot() { return root; }
+
+			static bool writeAll(int fd, const char *buf, size_t len);
+	};
+}
+
+#endif
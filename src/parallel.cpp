@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#include "parallel.h"
+
+using namespace std;
+
+unsigned reader::numThreads(unsigned threads)
+{
+	if (threads > 0)
+		return threads;
+
+	unsigned hw = thread::hardware_concurrency();
+	return hw > 0 ? hw : 1;
+}
+
+void reader::parallelFor(size_t count, const function<void(size_t)>& func, unsigned threads)
+{
+	threads = numThreads(threads);
+
+	if (threads > count)
+		threads = count;
+
+	if (threads <= 1)
+	{
+		for (size_t i = 0; i < count; ++i)
+			func(i);
+
+		return;
+	}
+
+	atomic<size_t> next(0);
+	vector<thread> workers;
+
+	for (unsigned t = 0; t < threads; ++t)
+	{
+		workers.emplace_back([&]()
+		{
+			size_t i;
+
+			while ((i = next.fetch_add(1)) < count)
+				func(i);
+		});
+	}
+
+	for (auto& w : workers)
+		w.join();
+}
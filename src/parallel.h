@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <cstddef>
+#include <functional>
+
+namespace reader
+{
+	/**
+	 * Calls \p func for every index from 0 to \p count - 1. The calls are
+	 * distributed over \p threads worker threads. If \p threads is 0, the
+	 * number of available CPU cores is used. The function returns when all
+	 * calls are finished.
+	 */
+	void parallelFor(size_t count, const std::function<void(size_t)>& func, unsigned threads = 0);
+	unsigned numThreads(unsigned threads);
+}
+
+#endif
@@ -21,6 +21,9 @@
 #include <sstream>
 #include <cstring>
 #include <iomanip>
+#include <memory>
+#include <thread>
+#include <atomic>
 #ifndef __APPLE__
 #include <bits/stdc++.h>
 #endif
@@ -29,20 +32,19 @@
 #else
 #include <filesystem>
 #endif
-#include "fsfreader.h"
 #include "readtp4.h"
 #include "expand.h"
 #include "scramble.h"
+#include "outdir.h"
+#include "writer.h"
+#include "xmlindex.h"
+#include "parallel.h"
+#include "trace.h"
 
 namespace fs = std::filesystem;
 using namespace reader;
 using namespace std;
 
-reader::ReadTP4::~ReadTP4()
-{
-	deleteIndex();
-}
-
 bool ReadTP4::doRead()
 {
 	if (fname.length() == 0)
@@ -51,206 +53,103 @@ bool ReadTP4::doRead()
 		return false;
 	}
 
-	ifstream fn (fname, ios::in | ios::binary);
+	Archive archive(fname, opts);
 
-	if (!fn.is_open())
-	{
-		cerr << "Could not open file " << fname << "!" << endl;
-		return false;
-	}
+	if (filter && !filter->empty())
+		archive.setFilter(filter);
 
-	struct HEADER head;
-	struct BLOCK block;
-	struct USAGE_BLOCK usageBlock;
-	struct FILE_HEAD fhead;
-	unsigned char memblock[1024];
+	if (!archive.open() || !archive.readIndex())
+		return false;
 
 	try
 	{
-		fn.read(reinterpret_cast<char*>(&head), SIZE_HEADER);
-
-		if (memcmp(head.abyFileID, "\0FSFILE\0", 8) != 0)
-		{
-			cerr << "File " << fname << " is not an FSF file!" << endl;
-			fn.close();
-			return false;
-		}
-
-		if (verbose)
-			cout << "First block starts at: " << to_string(head.listStartBlock) << endl << endl;
+		if (opts.verbose)
+			cout << endl << endl << "-- Starting to extract files ..." << endl << endl;
 
-		fn.read(reinterpret_cast<char*>(&memblock[0]), SIZE_BLOCK);
-		fillBlock(block, memblock);
-		fillFileHead(fhead, memblock);
+		// Now we read the files
+		OutputDir out(target);
+		unique_ptr<OutputWriter> writer;
 
-		if (verbose)
+		// A tar stream doesn't need the target directory.
+		if (!tarFile.empty())
+			writer.reset(new TarWriter(out, tarFile, tarFd));
+		else if (!out.open())
+			return false;
+		else
+			writer.reset(OutputWriter::create(writerType, out));
+
+		time_t newest = 0;
+		unique_ptr<PanelIndex> xmlIndex;
+
+		if (!xmlIndexName.empty())
+			xmlIndex.reset(new PanelIndex);
+
+		// The extraction is a pipeline: One thread reads the block chains,
+		// several threads decode them and this thread writes the files.
+		// The entries are given to the decoders round robin and collected
+		// in the same order. Every queue has exactly one producer and one
+		// consumer. The number of items in the pool limits the memory used.
+		unsigned cores = numThreads(mThreads);
+		unsigned threads = cores > 2 ? cores - 2 : 1;
+		size_t poolSize = threads * PIPE_DEPTH * 2;
+		vector<EXTRACT_ITEM> pool(poolSize);
+		SpscQueue<EXTRACT_ITEM *> freeItems(poolSize);
+		vector<unique_ptr<SpscQueue<EXTRACT_ITEM *>>> toDecoder, toWriter;
+		atomic<bool> abort{false};
+
+		for (size_t i = 0; i < poolSize; ++i)
+			freeItems.push(&pool[i]);
+
+		for (unsigned i = 0; i < threads; ++i)
 		{
-			cout << "thisBlock: " << to_string(block.thisBlock) << endl;
-			cout << "prevBlock: " << to_string(block.prevBlock) << endl;
-			cout << "nextBlock: " << to_string(block.nextBlock) << endl;
-			cout << "bytesUsed: " << to_string(block.bytesUsed) << endl << endl;
+			toDecoder.emplace_back(new SpscQueue<EXTRACT_ITEM *>(PIPE_DEPTH));
+			toWriter.emplace_back(new SpscQueue<EXTRACT_ITEM *>(PIPE_DEPTH));
 		}
 
-		uint32_t nextBlock = head.listStartBlock;
-		// first we read the index
-		while (nextBlock > 0)
-		{
-			fn.seekg(calcBlockPos(nextBlock), ios::beg);
-			fn.read(reinterpret_cast<char*>(memblock), SIZE_BLOCK);
-			fillUsageBlock(usageBlock, memblock);
-			fillFileHead(fhead, memblock);
-
-			if (fhead.thisBlock != nextBlock)
-			{
-				cerr << "No valid block position (" << to_string(fn.tellg()) << " [" << toHex(fn.tellg(), 8) << "])" << endl;
-				break;
-			}
-
-			if (verbose)
-			{
-				cout << "thisBlock: " << to_string(usageBlock.thisBlock) << " (" << toHex(usageBlock.thisBlock, 8) << ")" << endl;
-				cout << "prevBlock: " << to_string(usageBlock.prevBlock) << " (" << toHex(usageBlock.prevBlock, 8) << ")" << endl;
-				cout << "nextBlock: " << to_string(usageBlock.nextBlock) << " (" << toHex(usageBlock.nextBlock, 8) << ")" << endl;
-				cout << "bytesUsed: " << to_string(usageBlock.bytesUsed) << " (" << toHex(usageBlock.bytesUsed, 8) << ")" << endl;
-				cout << "filePath:  " << usageBlock.filePath << endl << endl;
-				cout << "creat time:" << asctime(gmtime(&usageBlock.tmCreate));
-				cout << "modif time:" << asctime(gmtime(&usageBlock.tmModify));
-				cout << "Flags:     " << to_string(usageBlock.flags) << endl;
-				cout << "startBlock:" << to_string(usageBlock.startBlock) << endl;
-				cout << "sizeBlocks:" << to_string(usageBlock.sizeBlocks) << endl;
-				cout << "sizeBytes: " << to_string(usageBlock.sizeBytes) << " (" << toHex(usageBlock.sizeBytes, 8) << ")" << endl << endl;
-			}
-
-			appendUBlock(&usageBlock);
-			nextBlock = fhead.nextBlock;
-		}
+		vector<thread> stages;
+		stages.emplace_back(&ReadTP4::readStage, this, ref(archive), ref(freeItems), ref(toDecoder), ref(abort));
 
-		if (verbose)
-			cout << endl << endl << "-- Starting to extract files ..." << endl << endl;
+		for (unsigned i = 0; i < threads; ++i)
+			stages.emplace_back(&ReadTP4::decodeStage, cref(archive), cache, ref(*toDecoder[i]), ref(*toWriter[i]), ref(abort));
 
-		// Now we read the files
-		struct INDEX *act = idx;
+		bool ok = true;
+		size_t failed = 0;
 
-		while (act != nullptr)
+		for (size_t n = 0; ; ++n)
 		{
-			string ofile;
+			EXTRACT_ITEM *item = toWriter[n % threads]->pop();
 
-			if (transfer)
-			{
-				string f(cp1250ToUTF8((char *)act->ublock->filePath));
-				struct MANIFEST mf;
-				mf.size = act->ublock->sizeBytes;
-				mf.tmCreate = act->ublock->tmCreate;
-				mf.tmModify = act->ublock->tmModify;
-				mf.fname.assign(f);
-				manifest.push_back(mf);
-				string dir;
-
-				if (f.find(".png") != string::npos || f.find(".jpg") != string::npos ||
-						f.find(".gif") != string::npos || f.find(".tiff") != string::npos)
-					dir = "/images";
-				else if (f.find(".wav") != string::npos || f.find(".mp3") != string::npos)
-					dir = "/sounds";
-				else if (f.find(".ttf") != string::npos)
-					dir = "/fonts";
-
-				if (verbose)
-					cout << "Testing for directory: " << target << dir << endl;
-
-				if (!fs::exists(target+dir))
-					fs::create_directories(target+dir);
-
-				ofile = target + dir + "/" + f;
-			}
-			else
-				ofile = target + "/" + string((char*)act->ublock->filePath);
-
-			cout << "Writing file " << ofile << endl;
-			ofstream of(ofile, ios::out | ios::binary);
-
-			if (!of)
-			{
-				cerr << "Error opening target file" << ofile << "!" << endl;
-				fn.close();
-				return false;
-			}
-
-			nextBlock = act->ublock->startBlock;
-			bool compressed = false;
-			bool encrypted = false;
+			if (!item)			// End of the pipeline
+				break;
 
-			for (uint32_t i = 0; i < act->ublock->sizeBlocks; i++)
+			// An entry which couldn't be read is skipped. The others are
+			// still extracted.
+			if (!item->readOk)
 			{
-				fn.seekg(calcBlockPos(nextBlock), ios::beg);
-				fn.read(reinterpret_cast<char*>(memblock), SIZE_BLOCK);
-				fillBlock(block, memblock);
-
-				if (i == 0)
-				{
-					if (block.abyData[0] == 0x1f && block.abyData[1] == 0x8b)
-						compressed = true;
-					else if ((ofile.find(".xma") != string::npos || ofile.find(".xml") != string::npos) &&
-							 block.abyData[0] != '<' && block.abyData[1] != '?')
-						encrypted = true;
-				}
-
-				nextBlock = block.nextBlock;
-				of.write(reinterpret_cast<char*>(block.abyData), block.bytesUsed);
-
-				if (verbose)
-				{
-					cout << "thisBlock: " << to_string(block.thisBlock) << " (" << toHex(block.thisBlock, 8) << ")" << endl;
-					cout << "prevBlock: " << to_string(block.prevBlock) << " (" << toHex(block.prevBlock, 8) << ")" << endl;
-					cout << "nextBlock: " << to_string(block.nextBlock) << " (" << toHex(block.nextBlock, 8) << ")" << endl;
-					cout << "blockSize: " << to_string(block.bytesUsed) << " (" << toHex(block.bytesUsed, 4) << ")" << endl << endl;
-				}
+				cerr << "Error reading " << item->ub->utf8Path << "!" << endl;
+				failed++;
 			}
-
-			of.close();
-
-			if (compressed)
+			else if (ok && !writeItem(*item, *writer, out, xmlIndex.get()))
 			{
-				cout << "Decompressing file " << ofile << " ...";
-				Expand exp(ofile);
-				int ret = exp.unzip();
-
-				if (ret != 0)
-					cerr << "WARNING: File " << ofile << " was not decompressed!" << endl;
-				else
-					cout << " done" << endl;
+				ok = false;
+				abort = true;
 			}
 
-			if (encrypted)
-			{
-				cout << "Decrypting file " << ofile << " ...";
-				Scramble scr;
-//				scr.aesInit("8P0puxB5OVUFI6uX", "MarkRobs");
-				scr.aesInit(password, salt);
+			newest = max(newest, item->ub->tmModify);
+			item->data.clear();
+			freeItems.push(item);
+		}
 
-				if (!scr.aesDecodeFile(ofile))
-					cerr << "WARNING: File " << ofile << " was not decrypted!" << endl;
-				else
-				{
-					cout << " done" << endl;
-					// Write buffer to file
-					ofstream outFile;
-					outFile.open(ofile, ios::out | ios::binary | ios::trunc);
-					string decr = scr.getDecrypted();
-					outFile.write(decr.c_str(), decr.length());
-					outFile.close();
-				}
-			}
+		for (auto itr = stages.begin(); itr != stages.end(); ++itr)
+			itr->join();
 
-			compressed = false;
-			act = act->next;
-		}
+		// A stage stopped by an exception sets abort as well.
+		if (!ok || abort)
+			return false;
 
-		if (transfer)
+		if (opts.transfer)
 		{
-			ofstream mfStream;
-			string manFileName = target + "/manifest.xma";
-
-			mfStream.open(manFileName, ios::out | ios::binary | ios::trunc);
+			stringstream mfStream;
 			sort(manifest.begin(), manifest.end(), compareManifest);
 			size_t num = manifest.size();
 			size_t cnt = 0;
@@ -266,179 +165,398 @@ bool ReadTP4::doRead()
 					mfStream << "\r\n";
 			}
 
-			mfStream.close();
+			string mf = mfStream.str();
+			writer->setModifyTime(newest);
+
+			if (!writer->writeFile("", "manifest.xma", mf.data(), mf.length()))
+				return false;
+		}
+
+		if (xmlIndex)
+		{
+			string js = xmlIndex->toJson();
+
+			if (!writer->writeFile("", xmlIndexName, js.data(), js.length()))
+				return false;
+		}
+
+		if (!writer->finish())
+			return false;
+
+		if (showStats)
+			writer->printStats();
+
+		if (cache)
+		{
+			cache->trim();
+
+			if (showStats || opts.verbose)
+				cache->printStats();
+		}
+
+		if (failed > 0)
+		{
+			cerr << failed << " files could not be read!" << endl;
+			return false;
 		}
 	}
 	catch (exception& e)
 	{
 		cerr << "ReadTP4::doRead: " << e.what() << endl;
-		fn.close();
 		return false;
 	}
 
-	fn.close();
 	return true;
 }
 
-void ReadTP4::fillBlock (struct BLOCK &bl, const unsigned char *buf)
+/*
+ * First stage of the pipeline: Reads the block chains of all entries. The
+ * entries are read in the order of their first block in the file and not
+ * in the order of the index. A chain is expected to be stored in
+ * consecutive blocks. The extents of neighbouring entries are read
+ * together with one pread(), so the file is read almost sequentially.
+ * Every block is checked against the chain. If an entry is stored in
+ * another way, its chain is followed block by block instead.
+ * The entries are distributed round robin over the decoders. At the end
+ * every decoder gets a nullptr, even if reading was stopped by an
+ * exception.
+ */
+void ReadTP4::readStage(Archive& archive, SpscQueue<EXTRACT_ITEM *>& freeItems, vector<unique_ptr<SpscQueue<EXTRACT_ITEM *>>>& toDecoder, atomic<bool>& abort)
 {
-	bl.thisBlock = makeDWord(buf);
-	bl.prevBlock = makeDWord(buf+4);
-	bl.nextBlock = makeDWord(buf+8);
-	bl.bytesUsed = makeWord(buf+12);
-	memcpy(&bl.abyData, buf+14, 512);
-}
+	size_t n = 0;
 
-void ReadTP4::fillUsageBlock (struct USAGE_BLOCK &ub, const unsigned char *buf)
-{
-	ub.thisBlock = makeDWord(buf);
-	ub.prevBlock = makeDWord(buf+4);
-	ub.nextBlock = makeDWord(buf+8);
-	ub.bytesUsed = makeWord(buf+12);
-	memcpy(&ub.filePath, buf+14, 260);
-	ub.tmCreate = makeDWord(buf+274);
-	ub.tmModify = makeDWord(buf+278);
-	ub.flags = makeDWord(buf+282);
-	ub.startBlock = makeDWord(buf+286);
-	ub.sizeBlocks = makeDWord(buf+290);
-	ub.sizeBytes = makeDWord(buf+294);
-}
+	try
+	{
+		// The options don't change while reading. One kernel is selected
+		// for all entries.
+		if (opts.verbose && opts.transfer)
+			readEntries<BLOCKS_DUMP, LAYOUT_TRANSFER>(archive, freeItems, toDecoder, abort, n);
+		else if (opts.verbose)
+			readEntries<BLOCKS_DUMP, LAYOUT_FLAT>(archive, freeItems, toDecoder, abort, n);
+		else if (opts.transfer)
+			readEntries<BLOCKS_QUIET, LAYOUT_TRANSFER>(archive, freeItems, toDecoder, abort, n);
+		else
+			readEntries<BLOCKS_QUIET, LAYOUT_FLAT>(archive, freeItems, toDecoder, abort, n);
+	}
+	catch (exception& e)
+	{
+		cerr << "ReadTP4::readStage: " << e.what() << endl;
+		abort = true;
+	}
 
-void ReadTP4::fillFileHead (struct FILE_HEAD &fh, const unsigned char *buf)
-{
-	fh.thisBlock = makeDWord(buf);
-	fh.prevBlock = makeDWord(buf+4);
-	fh.nextBlock = makeDWord(buf+8);
-	fh.blockLen = makeWord(buf+12);
+	// The end marker must follow the last entry in the round robin order.
+	for (size_t i = 0; i < toDecoder.size(); ++i)
+		toDecoder[(n + i) % toDecoder.size()]->push(nullptr);
 }
 
-struct INDEX *ReadTP4::appendUBlock (const struct USAGE_BLOCK *ub)
+/*
+ * Reads the entries and counts them in \p n.
+ */
+template<typename LOG, typename LAYOUT>
+void ReadTP4::readEntries(Archive& archive, SpscQueue<EXTRACT_ITEM *>& freeItems, vector<unique_ptr<SpscQueue<EXTRACT_ITEM *>>>& toDecoder, atomic<bool>& abort, size_t& n)
 {
-	struct USAGE_BLOCK *nb;
-	struct INDEX *act, *nidx;
+	vector<struct INDEX *> order(archive.getEntries());
+	vector<unsigned char> extent;
+	uint32_t numBlocks = archive.getNumBlocks();
+	size_t numExtents = 0, numChains = 0;
+
+	// The index is not trusted. Nothing is allocated for a chain reaching
+	// beyond the end of the file; it is followed block by block instead.
+	auto inFile = [numBlocks](const struct USAGE_BLOCK *ub)
+	{
+		return (uint64_t)ub->startBlock + ub->sizeBlocks <= numBlocks;
+	};
 
-	try
+	stable_sort(order.begin(), order.end(), [](const struct INDEX *a, const struct INDEX *b)
+	{
+		return a->ublock->startBlock < b->ublock->startBlock;
+	});
+
+	size_t e = 0;
+
+	while (e < order.size() && !abort)
 	{
-		nb = new struct USAGE_BLOCK;
-		memcpy(nb, ub, sizeof(struct USAGE_BLOCK));
+		// Collect the entries read with one pread().
+		uint32_t first = order[e]->ublock->startBlock;
+		uint32_t end = inFile(order[e]->ublock) ? first + order[e]->ublock->sizeBlocks : first;
+		size_t last = e;
 
-		if (idx == nullptr)
+		while (end > first && last + 1 < order.size())
 		{
-			act = new struct INDEX;
-			act->prev = nullptr;
-			act->next = nullptr;
-			act->ublock = nb;
-			idx = act;
+			const struct USAGE_BLOCK *ub = order[last + 1]->ublock;
+
+			if (!inFile(ub) || ub->startBlock < end || ub->startBlock - end > EXTENT_GAP ||
+					(size_t)ub->startBlock + ub->sizeBlocks - first > EXTENT_BLOCKS)
+				break;
+
+			end = ub->startBlock + ub->sizeBlocks;
+			last++;
 		}
-		else
+
+		bool extentOk = false;
+
+		if (end > first)
 		{
-			act = idx;
+			TraceScope scope(opts.trace, TRACE_READ);
+			extent.resize((size_t)(end - first) * SIZE_BLOCK);
+			extentOk = archive.readBlocks(first, end - first, extent.data());
+			numExtents++;
+		}
 
-			while (act->next != nullptr)
-				act = act->next;
+		for (; e <= last && !abort; ++e, ++n)
+		{
+			const struct USAGE_BLOCK *ub = order[e]->ublock;
+			EXTRACT_ITEM *item = freeItems.pop();
+			item->ub = ub;
+			item->dir.clear();
+			item->data.clear();
+			item->coding = CODING_PLAIN;
+			item->decodeOk = true;
+			nameItem<LAYOUT>(*item);
+			item->data.reserve(min({(size_t)ub->sizeBytes, (size_t)ub->sizeBlocks * SIZE_PAYLOAD, archive.getFileSize()}));
+
+			// The time waiting for a decoder is not part of the phase.
+			{
+				TraceScope scope(opts.trace, TRACE_READ, ub->utf8Path);
 
-			nidx = new struct INDEX;
-			nidx->prev = act;
-			nidx->next = nullptr;
-			nidx->ublock = nb;
-			act->next = nidx;
-			act = nidx;
+				if (!extentOk || !takeExtent<LOG>(*item, extent.data() + (size_t)(ub->startBlock - first) * SIZE_BLOCK))
+				{
+					item->data.clear();
+					item->readOk = readChain<LOG>(archive, *item);
+
+					if (ub->sizeBlocks > 0)
+						numChains++;
+				}
+				else
+					item->readOk = true;
+			}
+
+			toDecoder[n % toDecoder.size()]->push(item);
 		}
+
+		e = last + 1;
 	}
-	catch (exception& e)
+
+	if (LOG::dump)
+		cout << "Read " << n << " entries with " << numExtents << " extents; " << numChains << " entries were not stored in consecutive blocks." << endl << endl;
+}
+
+/*
+ * Sets the name and the directory of an entry. In transfer mode the
+ * entries are sorted into directories by their type.
+ */
+template<typename LAYOUT>
+void ReadTP4::nameItem(EXTRACT_ITEM& item)
+{
+	if constexpr (LAYOUT::transfer)
 	{
-		cerr << "ReadTP4::appendUBlock: " << e.what() << endl;
-		exit(3);
+		item.name.assign(item.ub->utf8Path);
+		item.dir = EntryFilter::typeDirectory(EntryFilter::entryType(item.name));
 	}
-
-	return act;
+	else
+		item.name.assign(item.ub->filePath);
 }
 
-void ReadTP4::deleteIndex()
+/*
+ * Takes the payload of an entry stored in consecutive blocks starting at
+ * \p buf. Returns FALSE if a block doesn't belong to the chain.
+ * The size of the data is summed up while the chain is checked. Then the
+ * payloads are copied into the buffer without growing it.
+ */
+template<typename LOG>
+bool ReadTP4::takeExtent(EXTRACT_ITEM& item, const unsigned char *buf)
 {
-	struct INDEX *tmp, *act = idx;
+	uint32_t start = item.ub->startBlock;
+	uint32_t count = item.ub->sizeBlocks;
+	size_t total = 0;
 
-	while (act != nullptr)
+	for (uint32_t i = 0; i < count; i++)
 	{
-		tmp = act->next;
+		BlockView block(buf + (size_t)i * SIZE_BLOCK);
 
-		if (act->ublock != nullptr)
-			delete act->ublock;
+		if (block.thisBlock() != start + i || (i + 1 < count && block.nextBlock() != start + i + 1))
+			return false;
 
-		delete act;
-		act = tmp;
+		total += block.payload().size;
 	}
 
-	idx = nullptr;
-}
+	item.data.resize(total);
+	char *dst = item.data.data();
 
-size_t ReadTP4::calcBlockPos (uint32_t block)
-{
-    if (block == 0)
-        return SIZE_HEADER;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		BlockView block(buf + (size_t)i * SIZE_BLOCK);
+		ByteSpan payload = block.payload();
+		memcpy(dst, payload.data, payload.size);
+		dst += payload.size;
 
-    size_t first = SIZE_HEADER;
-    return (first + (SIZE_BLOCK * block));
-}
+		if constexpr (LOG::dump)
+			dumpBlock(block);
+	}
 
-uint32_t ReadTP4::makeDWord (const unsigned char *buf)
-{
-	unsigned short b1, b2, b3, b4;
-
-	b1 = *buf;
-	b2 = *(buf+1);
-	b3 = *(buf+2);
-	b4 = *(buf+3);
-	uint32_t dword = ((b4 << 24) & 0xff000000) | ((b3 << 16) & 0x00ff0000) | ((b2 << 8) & 0x0000ff00) | b1;
-	return dword;
+	return true;
 }
 
-uint16_t ReadTP4::makeWord (const unsigned char *buf)
+/*
+ * Follows the chain of an entry block by block.
+ */
+template<typename LOG>
+bool ReadTP4::readChain(Archive& archive, EXTRACT_ITEM& item)
 {
-	uint16_t word = ((*(buf+1) << 8) & 0xff00) | *buf;
-	return word;
+	unsigned char memblock[SIZE_BLOCK] = {0};
+	BlockView block(memblock);
+	uint32_t nextBlock = item.ub->startBlock;
+
+	// A chain can't have more blocks than the file.
+	if (item.ub->sizeBlocks > archive.getNumBlocks())
+		return false;
+
+	for (uint32_t i = 0; i < item.ub->sizeBlocks; i++)
+	{
+		if (!archive.readBlock(nextBlock, memblock))
+			return false;
+
+		ByteSpan payload = block.payload();
+		item.data.append(payload.chars(), payload.size);
+		nextBlock = archive.nextLink(block);
+
+		if constexpr (LOG::dump)
+			dumpBlock(block);
+	}
+
+	return true;
 }
 
-string ReadTP4::toHex(int num, int width)
+void ReadTP4::dumpBlock(const BlockView& block)
 {
-	string ret;
-	std::stringstream s;
-	s << std::setfill ('0') << std::setw(width) << std::hex << num;
-	ret = s.str();
-	return ret;
+	cout << "thisBlock: " << to_string(block.thisBlock()) << " (" << Archive::toHex(block.thisBlock(), 8) << ")" << endl;
+	cout << "prevBlock: " << to_string(block.prevBlock()) << " (" << Archive::toHex(block.prevBlock(), 8) << ")" << endl;
+	cout << "nextBlock: " << to_string(block.nextBlock()) << " (" << Archive::toHex(block.nextBlock(), 8) << ")" << endl;
+	cout << "blockSize: " << to_string(block.bytesUsed()) << " (" << Archive::toHex(block.bytesUsed(), 4) << ")" << endl << endl;
 }
 
-void ReadTP4::dump (const unsigned char *buf, size_t size)
+/*
+ * Second stage of the pipeline: Decompresses or decrypts the entries. An
+ * entry whose decoding throws an exception is marked as not read and the
+ * extraction is aborted; the entries still coming are passed on.
+ */
+void ReadTP4::decodeStage(const Archive& archive, DecodeCache *cache, SpscQueue<EXTRACT_ITEM *>& in, SpscQueue<EXTRACT_ITEM *>& out, atomic<bool>& abort)
 {
-	short pos = 0;
-	char byte = 0;
-	bool nl = true;
+	string decoded, key;
 
-	for (size_t i = 0; i < size; i++)
+	while (EXTRACT_ITEM *item = in.pop())
 	{
-		if (nl)
-			cout << toHex(pos, 4) << ": ";
+		try
+		{
+			if (item->readOk)
+			{
+				TraceScope scope(archive.getOptions().trace, TRACE_DECODE, item->ub->utf8Path);
+				item->coding = Archive::detectCoding(item->name, reinterpret_cast<const unsigned char *>(item->data.data()), item->data.length());
+
+				bool cached = false;
 
-		nl = false;
-		byte = *(buf+i);
-		cout << toHex(byte&0x000000ff, 2) << " ";
+				// An entry decoded before is taken from the cache.
+				if (item->coding != CODING_PLAIN && cache)
+				{
+					key = DecodeCache::makeKey(item->coding, archive.getOptions(), item->data);
+
+					if (cache->lookup(key, decoded))
+					{
+						item->data.swap(decoded);
+						cached = true;
+					}
+				}
 
-		if (i > 0 && ((i+1) % 8) == 0)
+				if (item->coding != CODING_PLAIN && !cached)
+				{
+					item->decodeOk = archive.decode(item->coding, item->data, decoded);
+
+					if (item->decodeOk && cache)
+						cache->store(key, decoded);
+
+					if (item->decodeOk)
+						item->data.swap(decoded);
+				}
+			}
+		}
+		catch (exception& e)
 		{
-			pos = i + 1;
-			nl = true;
-			cout << endl;
+			cerr << "ReadTP4::decodeStage: " << item->ub->utf8Path << ": " << e.what() << endl;
+			item->readOk = false;
+			item->data.clear();
+			abort = true;
 		}
+
+		out.push(item);
 	}
 
-	cout << endl << endl;
+	out.push(nullptr);
+}
+
+/*
+ * Last stage of the pipeline: Writes one entry. This runs in the main
+ * thread and in the order the entries were read, which is the order of
+ * their first block in the file (see readStage()).
+ */
+bool ReadTP4::writeItem(EXTRACT_ITEM& item, OutputWriter& writer, OutputDir& out, PanelIndex *xmlIndex)
+{
+	string ofile = out.path(item.dir, item.name);
+	cout << "Writing file " << ofile << endl;
+
+	if (opts.transfer)
+	{
+		struct MANIFEST mf;
+		mf.size = item.ub->sizeBytes;
+		mf.tmCreate = item.ub->tmCreate;
+		mf.tmModify = item.ub->tmModify;
+		mf.fname = item.ub->utf8Path;
+		manifest.push_back(mf);
+	}
+
+	if (item.coding == CODING_GZIP)
+	{
+		cout << "Decompressing file " << ofile << " ...";
+
+		if (!item.decodeOk)
+			cerr << "WARNING: File " << ofile << " was not decompressed!" << endl;
+		else
+			cout << " done" << endl;
+	}
+	else if (item.coding == CODING_AES)
+	{
+		cout << "Decrypting file " << ofile << " ...";
+
+		if (!item.decodeOk)
+			cerr << "WARNING: File " << ofile << " was not decrypted!" << endl;
+		else
+			cout << " done" << endl;
+	}
+
+	// The XML files are scanned while they pass by.
+	if (xmlIndex && EntryFilter::entryType(item.name) == TYPE_XML)
+	{
+		xmlIndex->beginFile(item.name);
+		xmlIndex->feed(item.data.data(), item.data.length());
+		xmlIndex->endFile();
+	}
+
+	writer.setModifyTime(item.ub->tmModify);
+	TraceScope scope(opts.trace, TRACE_WRITE, item.ub->utf8Path);
+
+	if (!writer.writeFile(item.dir, item.name, item.data.data(), item.data.length()))
+	{
+		cerr << "Error writing target file " << ofile << "!" << endl;
+		return false;
+	}
+
+	return true;
 }
 
 bool ReadTP4::compareManifest(struct MANIFEST& m1, struct MANIFEST& m2)
 {
 	size_t pos1 = m1.fname.find_last_of(".");
 	size_t pos2 = m2.fname.find_last_of(".");
-	string ext1, ext2;
+	string_view ext1, ext2;
 	int weight1, weight2;
 
 	if (pos1 != string::npos)
@@ -478,50 +596,3 @@ bool ReadTP4::compareManifest(struct MANIFEST& m1, struct MANIFEST& m2)
 
 	return weight1 < weight2;
 }
-
-string ReadTP4::cp1250ToUTF8(const string& str)
-{
-	string out;
-
-	for (size_t j = 0; j < str.length(); j++)
-	{
-		int i = -1;
-		unsigned char ch = str.at(j);
-		short utf = -1;
-
-		if (ch < 0x80)
-		{
-			do
-			{
-				i++;
-
-				if (__cht[i].ch == ch)
-				{
-					utf = __cht[i].byte;
-					break;
-				}
-			}
-			while (__cht[i].ch != 0xff);
-
-			if (utf < 0)
-				utf = ch;
-		}
-		else
-			utf = ch;
-
-		if (utf > 0x00ff)
-		{
-			out.push_back((utf >> 8) & 0x00ff);
-			out.push_back(utf & 0x00ff);
-		}
-		else if (ch > 0x7f)
-		{
-			out.push_back(0xc0 | ch >> 6);
-			out.push_back(0x80 | (ch & 0x3f));
-		}
-		else
-			out.push_back(ch);
-	}
-
-	return out;
-}
@@ -7,7 +7,6 @@
 
 #include "scramble.h"
 #include "utils.h"
-#include "fsfreader.h"
 
 using std::string;
 using std::ifstream;
@@ -155,41 +154,58 @@ bool Scramble::aesDecodeFile(ifstream& is)
         return false;
     }
 
-    mDecrypted.clear();
     // Find file size
     is.seekg(0, ios_base::end);         // Seek to end of file
     size_t fileSize = is.tellg();       // Get current position (file size)
     is.seekg(0);                        // Seek to first byte of file
-    size_t pos = 0;                     // Position (offset) in input and output buffer
-    // Allocate space for input and output buffers
+    // Allocate space for input buffer
     unsigned char *buffer = new unsigned char[fileSize];
-    unsigned char *outBuffer = new unsigned char[fileSize];
-    unsigned char decBuffer[CHUNK_SIZE];    // Buffer for decoding a chunk.
-    unsigned char encBuffer[CHUNK_SIZE];    // Buffer for decoding a chunk.
-    int len = 0;
-    // Not really necessary, but initialize output buffer with zeros
-    memset(outBuffer, 0, fileSize);
     // Read whole file
     is.read(reinterpret_cast<char *>(buffer), fileSize);
+    bool state = aesDecodeBuffer(buffer, fileSize);
+    delete[] buffer;
+    return state;
+}
+
+/*
+ * Decrypts the buffer \p buf in memory. The clear text is available with
+ * getDecrypted() afterwards.
+ */
+bool Scramble::aesDecodeBuffer(const unsigned char *buf, size_t fileSize)
+{
+    if (!mAesInitialized || !mCtx)
+    {
+        cerr << "Class was not initialized!" << endl;
+        return false;
+    }
+
+    mDecrypted.clear();
+    size_t pos = 0;                     // Position (offset) in output buffer
+    // Allocate space for output buffer. The padding is never bigger than one
+    // cipher block.
+    unsigned char *outBuffer = new unsigned char[fileSize + AES128_KEY_SIZE];
+    int len = 0;
     // decode
     if (fileSize > CHUNK_SIZE)     // Is the file size greater then a chunk?
-    {                               // Yes, then start reading the file in chunks
+    {                               // Yes, then start decrypting the buffer in chunks
         size_t numBlocks = fileSize / CHUNK_SIZE;
 
         for (size_t i = 0; i < numBlocks; ++i)
         {
-            memcpy(encBuffer, buffer + i * CHUNK_SIZE, CHUNK_SIZE);
-
-            if (EVP_DecryptUpdate(mCtx, decBuffer, &len, encBuffer, CHUNK_SIZE) != OSSL_SUCCESS)
+            if (EVP_DecryptUpdate(mCtx, outBuffer+pos, &len, buf + i * CHUNK_SIZE, CHUNK_SIZE) != OSSL_SUCCESS)
             {
-                cerr << "Loop " << i << ": Error updating" << endl;
-                ERR_print_errors_fp(stderr);
-                delete[] buffer;
+                if (!mQuiet)
+                {
+                    cerr << "Loop " << i << ": Error updating" << endl;
+                    ERR_print_errors_fp(stderr);
+                }
+                else
+                    ERR_clear_error();
+
                 delete[] outBuffer;
                 return false;
             }
 
-            memcpy(outBuffer+pos, decBuffer, len);
             pos += len;
         }
 
@@ -197,27 +213,32 @@ bool Scramble::aesDecodeFile(ifstream& is)
 
         if (size2 > 0)      // Is there something left of the file less then CHUNK_SIZE?
         {                   // Yes, then decrypt it
-            memcpy(encBuffer, buffer + numBlocks * CHUNK_SIZE, size2);
-
-            if (EVP_DecryptUpdate(mCtx, decBuffer, &len, encBuffer, size2) != OSSL_SUCCESS)
+            if (EVP_DecryptUpdate(mCtx, outBuffer+pos, &len, buf + numBlocks * CHUNK_SIZE, size2) != OSSL_SUCCESS)
             {
-                cerr << "Error updating" << endl;
-                ERR_print_errors_fp(stderr);
-                delete[] buffer;
+                if (!mQuiet)
+                {
+                    cerr << "Error updating" << endl;
+                    ERR_print_errors_fp(stderr);
+                }
+                else
+                    ERR_clear_error();
+
                 delete[] outBuffer;
                 return false;
             }
 
-            memcpy(outBuffer+pos, decBuffer, len);
             pos += len;
         }
     }
     else
     {
-        if (EVP_DecryptUpdate(mCtx, outBuffer, &len, buffer, fileSize) != OSSL_SUCCESS)
+        if (EVP_DecryptUpdate(mCtx, outBuffer, &len, buf, fileSize) != OSSL_SUCCESS)
         {
-            ERR_print_errors_fp(stderr);
-            delete[] buffer;
+            if (!mQuiet)
+                ERR_print_errors_fp(stderr);
+            else
+                ERR_clear_error();
+
             delete[] outBuffer;
             return false;
         }
@@ -227,28 +248,98 @@ bool Scramble::aesDecodeFile(ifstream& is)
 
     if (EVP_DecryptFinal_ex(mCtx, outBuffer + pos, &len) != OSSL_SUCCESS)
     {
+        if (mQuiet)
+        {
+            ERR_clear_error();
+            delete[] outBuffer;
+            return false;
+        }
+
         cerr << "Error finalizing" << endl;
 
-        if (verbose)
+        if (mVerbose)
         {
             cout << "DEBUG: pos: " << pos << ", len: " << len << endl;
             cout << "DEBUG: " << formatHex(outBuffer, 24) << endl;
         }
 
         ERR_print_errors_fp(stderr);
-        delete[] buffer;
         delete[] outBuffer;
         return false;
     }
 
     pos += len;
     mDecrypted.assign(reinterpret_cast<char *>(outBuffer), pos);
-    delete[] buffer;
     delete[] outBuffer;
 
     return true;
 }
 
+/*
+ * Decrypts the next \p len bytes of a stream and appends the clear text
+ * to \p out. The last cipher block is held back until the next call or
+ * aesDecodeFinal(), because it contains the padding.
+ */
+bool Scramble::aesDecodeUpdate(const unsigned char *buf, size_t len, string& out)
+{
+    if (!mAesInitialized || !mCtx)
+    {
+        cerr << "Class was not initialized!" << endl;
+        return false;
+    }
+
+    size_t pos = out.length();
+    int outLen = 0;
+
+    out.resize(pos + len + AES128_KEY_SIZE);
+
+    if (EVP_DecryptUpdate(mCtx, reinterpret_cast<unsigned char *>(&out[pos]), &outLen, buf, len) != OSSL_SUCCESS)
+    {
+        if (!mQuiet)
+        {
+            cerr << "Error updating" << endl;
+            ERR_print_errors_fp(stderr);
+        }
+        else
+            ERR_clear_error();
+
+        out.resize(pos);
+        return false;
+    }
+
+    out.resize(pos + outLen);
+    return true;
+}
+
+/*
+ * Ends a stream decrypted with aesDecodeUpdate(). The padding is checked
+ * and the rest of the clear text is appended to \p out.
+ */
+bool Scramble::aesDecodeFinal(string& out)
+{
+    size_t pos = out.length();
+    int outLen = 0;
+
+    out.resize(pos + AES128_KEY_SIZE);
+
+    if (EVP_DecryptFinal_ex(mCtx, reinterpret_cast<unsigned char *>(&out[pos]), &outLen) != OSSL_SUCCESS)
+    {
+        if (!mQuiet)
+        {
+            cerr << "Error finalizing" << endl;
+            ERR_print_errors_fp(stderr);
+        }
+        else
+            ERR_clear_error();
+
+        out.resize(pos);
+        return false;
+    }
+
+    out.resize(pos + outLen);
+    return true;
+}
+
 bool Scramble::aesEncodeFile(const string& fname)
 {
     if (fname.empty())
@@ -378,3 +469,53 @@ bool Scramble::aesEncodeFile(ifstream& is)
 
     return true;
 }
+
+/*
+ * Encrypts the buffer \p buf in memory. The cipher text is available with
+ * getDecrypted() afterwards.
+ */
+bool Scramble::aesEncodeBuffer(const unsigned char *buf, size_t fileSize)
+{
+    if (!mAesInitialized || !mCtx)
+    {
+        cerr << "Class was not initialized!" << endl;
+        return false;
+    }
+
+    mDecrypted.clear();
+    size_t in = 0;                      // Position (offset) in input buffer
+    size_t pos = 0;                     // Position (offset) in output buffer
+    // The padding adds at most one cipher block.
+    unsigned char *outBuffer = new unsigned char[fileSize + AES128_KEY_SIZE];
+    int len = 0;
+
+    while (in < fileSize)
+    {
+        int size = (int)min((size_t)CHUNK_SIZE, fileSize - in);
+
+        if (EVP_EncryptUpdate(mCtx, outBuffer + pos, &len, buf + in, size) != OSSL_SUCCESS)
+        {
+            cerr << "Error updating" << endl;
+            ERR_print_errors_fp(stderr);
+            delete[] outBuffer;
+            return false;
+        }
+
+        in += size;
+        pos += len;
+    }
+
+    if (EVP_EncryptFinal_ex(mCtx, outBuffer + pos, &len) != OSSL_SUCCESS)
+    {
+        cerr << "Error finalizing" << endl;
+        ERR_print_errors_fp(stderr);
+        delete[] outBuffer;
+        return false;
+    }
+
+    pos += len;
+    mDecrypted.assign(reinterpret_cast<char *>(outBuffer), pos);
+    delete[] outBuffer;
+
+    return true;
+}
@@ -16,13 +16,19 @@ class Scramble
         bool aesInit(const std::string& key, const std::string& salt, bool encrypt=false);
         bool aesDecodeFile(std::ifstream& is);
         bool aesDecodeFile(const std::string& fname);
+        bool aesDecodeBuffer(const unsigned char *buf, size_t len);
+        bool aesDecodeUpdate(const unsigned char *buf, size_t len, std::string& out);
+        bool aesDecodeFinal(std::string& out);
         bool aesEncodeFile(std::ifstream& is);
         bool aesEncodeFile(const std::string& fname);
+        bool aesEncodeBuffer(const unsigned char *buf, size_t len);
         unsigned char *getAesKey(size_t& len) { len = AES128_KEY_SIZE; return mAesKey; }
         unsigned char *getAesSalt(size_t& len) { len = AES128_SALT_SIZE; return mAesSalt; }
         unsigned char *getAesIV(size_t& len) { len = AES128_KEY_SIZE; return mAesIV; }
         std::string& getDecrypted() { return mDecrypted; }
         void aesReset() { mAesInitialized = false; }
+        void setQuiet(bool q) { mQuiet = q; }
+        void setVerbose(bool v) { mVerbose = v; }
 
     private:
         unsigned char mAesKey[AES128_KEY_SIZE];     // Key used for decryption/encryption
@@ -31,6 +37,8 @@ class Scramble
         EVP_CIPHER_CTX *mCtx{nullptr};              // Context
         std::string mDecrypted;                     // Buffer for clear (decrypted) text
         bool mAesInitialized{false};                // TRUE if initialized
+        bool mQuiet{false};                         // TRUE suppresses error messages while decoding
+        bool mVerbose{false};                       // TRUE prints debug information on errors
 };
 
 #endif
@@ -0,0 +1,672 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "server.h"
+#include "outdir.h"
+#include "filter.h"
+
+#define MAX_LINE	65536		// Longest request accepted
+
+namespace fs = std::filesystem;
+using namespace reader;
+using namespace std;
+
+Server::~Server()
+{
+	if (listenFd >= 0)
+	{
+		::close(listenFd);
+		unlink(socketPath.c_str());
+	}
+}
+
+/*
+ * Listens on the socket until a STOP request arrives. A socket left by a
+ * server that was killed is replaced. If another server is listening on
+ * the socket, FALSE is returned.
+ */
+bool Server::serve()
+{
+	struct sockaddr_un addr;
+
+	if (!socketAddress(socketPath, addr))
+		return false;
+
+	int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+	{
+		::close(probe);
+		cerr << "Another server is listening on socket " << socketPath << "!" << endl;
+		return false;
+	}
+
+	if (probe >= 0)
+		::close(probe);
+
+	struct stat st;
+
+	if (lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(socketPath.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+	{
+		cerr << "Could not listen on socket " << socketPath << ": " << strerror(errno) << endl;
+
+		if (fd >= 0)
+			::close(fd);
+
+		return false;
+	}
+
+	listenFd = fd;
+	cout << "Listening on " << socketPath << endl;
+	bool ok = true;
+
+	while (!stopped)
+	{
+		// More connections wait in the backlog of the socket until a
+		// thread is free.
+		if (active >= SERVER_CONNECTIONS)
+		{
+			this_thread::sleep_for(chrono::milliseconds(10));
+			continue;
+		}
+
+		int conn = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+
+		if (conn < 0)
+		{
+			if (stopped)
+				break;
+
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			// Out of descriptors: Try again when a connection was closed.
+			if (errno == EMFILE || errno == ENFILE)
+			{
+				this_thread::sleep_for(chrono::milliseconds(10));
+				continue;
+			}
+
+			cerr << "Error accepting a connection: " << strerror(errno) << endl;
+			ok = false;
+			stop();
+			break;
+		}
+
+		lock_guard<mutex> lock(cacheMutex);
+		connections.insert(conn);
+		active++;
+		thread(&Server::handleConnection, this, conn).detach();
+	}
+
+	// The threads of the open connections must end before the caches are
+	// destroyed.
+	while (active > 0)
+		this_thread::sleep_for(chrono::milliseconds(10));
+
+	cout << "Server stopped." << endl;
+	return ok;
+}
+
+/*
+ * Ends serve(). Open connections are shut down, so that their threads
+ * end after the current request.
+ */
+void Server::stop()
+{
+	stopped = true;
+	lock_guard<mutex> lock(cacheMutex);
+
+	for (auto itr = connections.begin(); itr != connections.end(); ++itr)
+		shutdown(*itr, SHUT_RDWR);
+
+	shutdown(listenFd, SHUT_RDWR);
+}
+
+void Server::handleConnection(int fd)
+{
+	string buffer, line;
+
+	while (!stopped && readLine(fd, buffer, line))
+	{
+		if (!handleRequest(fd, split(line)))
+			break;
+	}
+
+	{
+		lock_guard<mutex> lock(cacheMutex);
+		connections.erase(fd);
+	}
+
+	::close(fd);
+	active--;
+}
+
+/*
+ * Answers one request. Returns FALSE if the connection should be closed.
+ */
+bool Server::handleRequest(int fd, const vector<string>& fields)
+{
+	if (fields.empty() || fields[0].empty())
+		return sendAnswer(fd, false, "Empty request");
+
+	const string& cmd = fields[0];
+
+	if (cmd == "STOP")
+	{
+		sendAnswer(fd, true, "");
+		stop();
+		return false;
+	}
+
+	if (cmd != "LIST" && cmd != "CAT" && cmd != "EXTRACT")
+		return sendAnswer(fd, false, "Unknown request " + cmd);
+
+	if (fields.size() < 2)
+		return sendAnswer(fd, false, "Missing archive");
+
+	string error;
+	shared_ptr<CACHED_ARCHIVE> ca = getArchive(fields[1], error);
+
+	if (!ca)
+		return sendAnswer(fd, false, error);
+
+	if (cmd == "LIST")
+		return sendAnswer(fd, true, listEntries(*ca->archive));
+
+	if (cmd == "EXTRACT")
+	{
+		string answer;
+		bool ok = extract(*ca, fields, answer);
+		return sendAnswer(fd, ok, answer);
+	}
+
+	if (fields.size() < 3)
+		return sendAnswer(fd, false, "Missing entry");
+
+	const struct USAGE_BLOCK *ub = ca->archive->findEntry(fields[2]);
+
+	if (!ub)
+		return sendAnswer(fd, false, "The file " + fields[2] + " is not part of " + fields[1]);
+
+	shared_ptr<const string> data = getEntry(*ca, ub, error);
+
+	if (!data)
+		return sendAnswer(fd, false, error);
+
+	return sendAnswer(fd, true, *data);
+}
+
+/*
+ * Returns the archive \p file with its index. An open archive is used as
+ * long as the file was not changed. The least recently used archive is
+ * closed if there are too many.
+ */
+shared_ptr<Server::CACHED_ARCHIVE> Server::getArchive(const string& file, string& error)
+{
+	struct stat st;
+
+	if (file.empty() || file[0] != '/')
+	{
+		error = "The path " + file + " is not absolute";
+		return nullptr;
+	}
+
+	if (stat(file.c_str(), &st) != 0)
+	{
+		error = "Can't access " + file + ": " + strerror(errno);
+		return nullptr;
+	}
+
+	{
+		lock_guard<mutex> lock(cacheMutex);
+		auto itr = archives.find(file);
+
+		if (itr != archives.end())
+		{
+			CACHED_ARCHIVE& ca = *itr->second;
+
+			if (ca.dev == st.st_dev && ca.ino == st.st_ino && ca.size == st.st_size &&
+				ca.mtime.tv_sec == st.st_mtim.tv_sec && ca.mtime.tv_nsec == st.st_mtim.tv_nsec)
+			{
+				ca.lastUse = ++useCounter;
+				return itr->second;
+			}
+
+			dropHotEntries(ca.id);
+			archives.erase(itr);
+		}
+	}
+
+	// The index is read without holding the lock.
+	shared_ptr<CACHED_ARCHIVE> ca = make_shared<CACHED_ARCHIVE>();
+	ca->archive.reset(new Archive(file, opts));
+
+	if (!ca->archive->open() || !ca->archive->readIndex())
+	{
+		error = "Can't read the index of " + file;
+		return nullptr;
+	}
+
+	ca->dev = st.st_dev;
+	ca->ino = st.st_ino;
+	ca->size = st.st_size;
+	ca->mtime = st.st_mtim;
+
+	lock_guard<mutex> lock(cacheMutex);
+	ca->id = nextId++;
+	ca->lastUse = ++useCounter;
+	archives[file] = ca;
+
+	while (archives.size() > SERVER_ARCHIVES)
+	{
+		auto oldest = archives.begin();
+
+		for (auto itr = archives.begin(); itr != archives.end(); ++itr)
+		{
+			if (itr->second->lastUse < oldest->second->lastUse)
+				oldest = itr;
+		}
+
+		dropHotEntries(oldest->second->id);
+		archives.erase(oldest);
+	}
+
+	return ca;
+}
+
+/*
+ * Returns the decoded data of the entry \p ub. Recently used entries are
+ * taken from memory.
+ */
+shared_ptr<const string> Server::getEntry(const CACHED_ARCHIVE& ca, const struct USAGE_BLOCK *ub, string& error)
+{
+	HOT_KEY key(ca.id, ub);
+
+	{
+		lock_guard<mutex> lock(cacheMutex);
+		auto itr = hotMap.find(key);
+
+		if (itr != hotMap.end())
+		{
+			hotList.splice(hotList.begin(), hotList, itr->second);
+			return itr->second->data;
+		}
+	}
+
+	string raw;
+	shared_ptr<string> data = make_shared<string>();
+
+	if (!ca.archive->readChain(ub, raw))
+	{
+		error = "Can't read " + string(ub->filePath);
+		return nullptr;
+	}
+
+	CODING coding = Archive::detectCoding(ub->filePath, reinterpret_cast<const unsigned char *>(raw.data()), raw.length());
+
+	if (coding == CODING_PLAIN)
+		data->swap(raw);
+	else if (!ca.archive->decode(coding, raw, *data, true))
+	{
+		error = "Can't decode " + string(ub->filePath);
+		return nullptr;
+	}
+
+	if (data->length() > SERVER_HOT_ENTRY)
+		return data;
+
+	lock_guard<mutex> lock(cacheMutex);
+
+	if (hotMap.find(key) == hotMap.end())
+	{
+		hotList.push_front(HOT_ENTRY{key, data});
+		hotMap[key] = hotList.begin();
+		hotBytes += data->length();
+
+		while (hotBytes > SERVER_HOT_BYTES)
+		{
+			hotBytes -= hotList.back().data->length();
+			hotMap.erase(hotList.back().key);
+			hotList.pop_back();
+		}
+	}
+
+	return data;
+}
+
+/*
+ * Removes all decoded entries of the archive with \p id from memory. The
+ * caller must hold the lock.
+ */
+void Server::dropHotEntries(uint64_t id)
+{
+	for (auto itr = hotList.begin(); itr != hotList.end(); )
+	{
+		if (itr->key.first != id)
+		{
+			++itr;
+			continue;
+		}
+
+		hotBytes -= itr->data->length();
+		hotMap.erase(itr->key);
+		itr = hotList.erase(itr);
+	}
+}
+
+/*
+ * Writes the entries named in the request, or all of them, into the
+ * directory of the request.
+ */
+bool Server::extract(const CACHED_ARCHIVE& ca, const vector<string>& fields, string& answer)
+{
+	if (fields.size() < 4)
+	{
+		answer = "Missing directory";
+		return false;
+	}
+
+	const string& dir = fields[2];
+	bool transfer = fields[3] == "1";
+	vector<const struct USAGE_BLOCK *> list;
+
+	if (dir.empty() || dir[0] != '/')
+	{
+		answer = "The path " + dir + " is not absolute";
+		return false;
+	}
+
+	if (fields.size() > 4)
+	{
+		for (size_t i = 4; i < fields.size(); ++i)
+		{
+			const struct USAGE_BLOCK *ub = ca.archive->findEntry(fields[i]);
+
+			if (!ub)
+			{
+				answer = "The file " + fields[i] + " is not part of " + fields[1];
+				return false;
+			}
+
+			list.push_back(ub);
+		}
+	}
+	else
+	{
+		const vector<struct INDEX *>& entries = ca.archive->getEntries();
+
+		for (auto itr = entries.begin(); itr != entries.end(); ++itr)
+			list.push_back((*itr)->ublock);
+	}
+
+	error_code ec;
+	fs::create_directories(dir, ec);
+	OutputDir out(dir);
+
+	if (!out.open())
+	{
+		answer = "Can't open the directory " + dir;
+		return false;
+	}
+
+	size_t bytes = 0;
+
+	for (auto itr = list.begin(); itr != list.end(); ++itr)
+	{
+		string name(transfer ? (*itr)->utf8Path : (*itr)->filePath);
+		string sub = transfer ? EntryFilter::typeDirectory(EntryFilter::entryType(name)) : string();
+		shared_ptr<const string> data = getEntry(ca, *itr, answer);
+
+		if (!data)
+			return false;
+
+		if (!out.writeFile(sub, name, data->data(), data->length()))
+		{
+			answer = "Can't write " + out.path(sub, name);
+			return false;
+		}
+
+		bytes += data->length();
+	}
+
+	answer = "Extracted " + to_string(list.size()) + " files with " + to_string(bytes) + " bytes into " + dir + ".\n";
+	return true;
+}
+
+/*
+ * Returns the index of \p archive as text. One line per entry: size,
+ * modification time and path, separated by tabs.
+ */
+string Server::listEntries(Archive& archive)
+{
+	stringstream ss;
+	const vector<struct INDEX *>& entries = archive.getEntries();
+
+	for (auto itr = entries.begin(); itr != entries.end(); ++itr)
+	{
+		const struct USAGE_BLOCK *ub = (*itr)->ublock;
+		ss << ub->sizeBytes << "\t" << ub->tmModify << "\t" << ub->utf8Path << "\n";
+	}
+
+	return ss.str();
+}
+
+/*
+ * The client: Sends one request to the server listening on \p sock and
+ * writes the data of the answer to \p outFd. Returns the exit code of
+ * the program.
+ */
+int Server::request(const string& sock, const vector<string>& fields, int outFd)
+{
+	struct sockaddr_un addr;
+	string req;
+
+	if (!socketAddress(sock, addr))
+		return 2;
+
+	for (size_t i = 0; i < fields.size(); ++i)
+	{
+		if (fields[i].find_first_of("\t\n") != string::npos)
+		{
+			cerr << "A path must not contain tabs or newlines: " << fields[i] << endl;
+			return 2;
+		}
+
+		req += (i > 0 ? "\t" : "") + fields[i];
+	}
+
+	req += "\n";
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+	{
+		cerr << "Could not connect to server at " << sock << ": " << strerror(errno) << endl;
+
+		if (fd >= 0)
+			::close(fd);
+
+		return 2;
+	}
+
+	string buffer, header;
+
+	if (!sendAll(fd, req.data(), req.length()) || !readLine(fd, buffer, header))
+	{
+		cerr << "Got no answer from server at " << sock << "!" << endl;
+		::close(fd);
+		return 2;
+	}
+
+	vector<string> answer = split(header);
+
+	if (answer[0] != "OK" || answer.size() < 2)
+	{
+		cerr << "ERROR: " << (answer.size() > 1 ? answer[1] : header) << endl;
+		::close(fd);
+		return 2;
+	}
+
+	// The rest of the buffer is the start of the data.
+	size_t len = strtoull(answer[1].c_str(), nullptr, 10);
+	size_t have = min(len, buffer.length());
+	bool ok = OutputDir::writeAll(outFd, buffer.data(), have);
+	char chunk[65536];
+
+	while (ok && have < len)
+	{
+		ssize_t r = recv(fd, chunk, min(sizeof(chunk), len - have), 0);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r <= 0)
+		{
+			cerr << "The connection to the server was closed after " << have << " of " << len << " bytes!" << endl;
+			ok = false;
+			break;
+		}
+
+		ok = OutputDir::writeAll(outFd, chunk, r);
+		have += r;
+	}
+
+	::close(fd);
+	return ok ? 0 : 2;
+}
+
+bool Server::sendAll(int fd, const char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t w = send(fd, buf, len, MSG_NOSIGNAL);
+
+		if (w < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		buf += w;
+		len -= w;
+	}
+
+	return true;
+}
+
+bool Server::sendAnswer(int fd, bool ok, const string& data)
+{
+	if (!ok)
+	{
+		string msg = "ERROR\t" + data;
+		replace(msg.begin() + 6, msg.end(), '\n', ' ');
+		msg += "\n";
+		return sendAll(fd, msg.data(), msg.length());
+	}
+
+	string header = "OK\t" + to_string(data.length()) + "\n";
+
+	// Small answers are sent in one piece.
+	if (data.length() < 4096)
+	{
+		header += data;
+		return sendAll(fd, header.data(), header.length());
+	}
+
+	return sendAll(fd, header.data(), header.length()) && sendAll(fd, data.data(), data.length());
+}
+
+/*
+ * Reads the next line from \p fd into \p line. Bytes read behind the line
+ * stay in \p buffer.
+ */
+bool Server::readLine(int fd, string& buffer, string& line)
+{
+	size_t pos;
+	char chunk[4096];
+
+	while ((pos = buffer.find('\n')) == string::npos)
+	{
+		if (buffer.length() > MAX_LINE)
+			return false;
+
+		ssize_t r = recv(fd, chunk, sizeof(chunk), 0);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r <= 0)
+			return false;
+
+		buffer.append(chunk, r);
+	}
+
+	line.assign(buffer, 0, pos);
+	buffer.erase(0, pos + 1);
+	return true;
+}
+
+vector<string> Server::split(const string& line)
+{
+	vector<string> fields;
+	size_t start = 0, pos;
+
+	while ((pos = line.find('\t', start)) != string::npos)
+	{
+		fields.push_back(line.substr(start, pos - start));
+		start = pos + 1;
+	}
+
+	fields.push_back(line.substr(start));
+	return fields;
+}
+
+bool Server::socketAddress(const string& sock, struct sockaddr_un& addr)
+{
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if (sock.empty() || sock.length() >= sizeof(addr.sun_path))
+	{
+		cerr << "Invalid socket path " << sock << "!" << endl;
+		return false;
+	}
+
+	memcpy(addr.sun_path, sock.data(), sock.length());
+	return true;
+}
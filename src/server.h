@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <set>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include "archive.h"
+
+#define SERVER_ARCHIVES		8					// Archives kept open
+#define SERVER_HOT_BYTES	(64 * 1024 * 1024)	// Decoded entries kept in memory
+#define SERVER_HOT_ENTRY	(SERVER_HOT_BYTES / 4)	// Bigger entries are not kept
+#define SERVER_CONNECTIONS	64					// Connections served at the same time
+
+namespace reader
+{
+	/**
+	 * A long running process answering requests on a Unix domain socket.
+	 * Recently used archives stay open with their index, and recently
+	 * decoded entries are kept in memory. A request is one line of fields
+	 * separated by tabs:
+	 *
+	 *   LIST <archive>
+	 *   CAT <archive> <entry>
+	 *   EXTRACT <archive> <directory> <transfer 0|1> [<entry> ...]
+	 *   STOP
+	 *
+	 * The answer is "OK <length>" followed by <length> bytes of data, or
+	 * "ERROR <message>". Both are ended by a newline. Paths must be
+	 * absolute. An archive is opened again if it was changed on disk.
+	 * Every connection is served by its own thread and may send several
+	 * requests. At most SERVER_CONNECTIONS connections are served at the
+	 * same time; more wait until one is closed.
+	 */
+	class Server
+	{
+		struct CACHED_ARCHIVE
+		{
+			uint64_t id{0};
+			std::unique_ptr<Archive> archive;
+			dev_t dev{0};
+			ino_t ino{0};
+			struct timespec mtime{0, 0};
+			off_t size{0};
+			uint64_t lastUse{0};
+		};
+
+		typedef std::pair<uint64_t, const struct USAGE_BLOCK *> HOT_KEY;
+
+		struct HOT_ENTRY
+		{
+			HOT_KEY key;
+			std::shared_ptr<const std::string> data;
+		};
+
+		std::string socketPath;
+		OPTIONS opts;
+		int listenFd{-1};
+		std::atomic<bool> stopped{false};
+		std::atomic<int> active{0};		// Connections being served
+		std::mutex cacheMutex;			// Protects the members below
+		std::set<int> connections;
+		uint64_t useCounter{0};
+		uint64_t nextId{1};
+		std::map<std::string, std::shared_ptr<CACHED_ARCHIVE>> archives;
+		std::list<HOT_ENTRY> hotList;	// Most recently used first
+		std::map<HOT_KEY, std::list<HOT_ENTRY>::iterator> hotMap;
+		size_t hotBytes{0};
+
+		public:
+			Server(const std::string& sock, const OPTIONS& o = OPTIONS())
+				: socketPath{sock},
+				  opts{o}
+			{}
+
+			~Server();
+
+			bool serve();
+
+			static std::string listEntries(Archive& archive);
+			static int request(const std::string& sock, const std::vector<std::string>& fields, int outFd);
+
+		private:
+			void handleConnection(int fd);
+			bool handleRequest(int fd, const std::vector<std::string>& fields);
+			std::shared_ptr<CACHED_ARCHIVE> getArchive(const std::string& file, std::string& error);
+			std::shared_ptr<const std::string> getEntry(const CACHED_ARCHIVE& ca, const struct USAGE_BLOCK *ub, std::string& error);
+			bool extract(const CACHED_ARCHIVE& ca, const std::vector<std::string>& fields, std::string& answer);
+			void dropHotEntries(uint64_t id);
+			void stop();
+
+			static bool sendAll(int fd, const char *buf, size_t len);
+			static bool sendAnswer(int fd, bool ok, const std::string& data);
+			static bool readLine(int fd, std::string& buffer, std::string& line);
+			static std::vector<std::string> split(const std::string& line);
+			static bool socketAddress(const std::string& sock, struct sockaddr_un& addr);
+	};
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+#ifndef __SPSCQUEUE_H__
+#define __SPSCQUEUE_H__
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+#define SPSC_SPIN			64		// Tries with yield() before a waiting thread sleeps
+
+namespace reader
+{
+	/**
+	 * A bounded lock free queue for exactly one producer thread and one
+	 * consumer thread. push() waits while the queue is full and pop() waits
+	 * while it is empty. This gives the back-pressure between two stages of
+	 * a pipeline.
+	 *
+	 * A waiting thread tries SPSC_SPIN times and then sleeps on a condition
+	 * variable, so an idle stage uses no CPU while another one waits for
+	 * I/O. The other side takes the mutex only if somebody sleeps.
+	 */
+	template<typename T>
+	class SpscQueue
+	{
+		std::vector<T> ring;
+		size_t mask{0};
+		alignas(64) std::atomic<size_t> head{0};	// Next element to read; written by the consumer
+		alignas(64) std::atomic<size_t> tail{0};	// Next free slot; written by the producer
+		alignas(64) std::atomic<int> sleepers{0};	// Threads waiting on cond
+		std::mutex mtx;
+		std::condition_variable cond;
+
+		public:
+			explicit SpscQueue(size_t capacity)
+			{
+				size_t size = 1;
+
+				while (size < capacity)
+					size <<= 1;
+
+				ring.resize(size);
+				mask = size - 1;
+			}
+
+			SpscQueue(const SpscQueue&) = delete;
+			SpscQueue& operator=(const SpscQueue&) = delete;
+
+			bool tryPush(const T& value)
+			{
+				size_t t = tail.load(std::memory_order_relaxed);
+
+				if (t - head.load(std::memory_order_acquire) == ring.size())
+					return false;
+
+				ring[t & mask] = value;
+				tail.store(t + 1, std::memory_order_release);
+				return true;
+			}
+
+			bool tryPop(T& value)
+			{
+				size_t h = head.load(std::memory_order_relaxed);
+
+				if (h == tail.load(std::memory_order_acquire))
+					return false;
+
+				value = ring[h & mask];
+				head.store(h + 1, std::memory_order_release);
+				return true;
+			}
+
+			void push(const T& value)
+			{
+				wait([&] { return tryPush(value); });
+				wake();
+			}
+
+			T pop()
+			{
+				T value;
+
+				wait([&] { return tryPop(value); });
+				wake();
+				return value;
+			}
+
+		private:
+			template<typename F>
+			void wait(F tryOnce)
+			{
+				for (int i = 0; i < SPSC_SPIN; ++i)
+				{
+					if (tryOnce())
+						return;
+
+					std::this_thread::yield();
+				}
+
+				// The fence pairs with the one in wake(): Either the other
+				// side sees the sleeper or the last try sees its change.
+				std::unique_lock<std::mutex> lock(mtx);
+				sleepers.fetch_add(1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				cond.wait(lock, tryOnce);
+				sleepers.fetch_sub(1, std::memory_order_relaxed);
+			}
+
+			void wake()
+			{
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+
+				if (sleepers.load(std::memory_order_relaxed) > 0)
+				{
+					std::lock_guard<std::mutex> lock(mtx);
+					cond.notify_all();
+				}
+			}
+	};
+}
+
+#endif
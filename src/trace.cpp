@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+#include <iostream>
+#include <fstream>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+#include "xmlindex.h"
+
+using namespace reader;
+using namespace std;
+
+Trace::~Trace()
+{
+	save();
+}
+
+void Trace::add(TRACE_PHASE phase, string_view label, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+{
+	EVENT ev;
+	ev.phase = phase;
+	ev.label.assign(label);
+	ev.start = chrono::duration_cast<chrono::microseconds>(start - origin).count();
+	ev.duration = chrono::duration_cast<chrono::microseconds>(end - start).count();
+	ev.tid = syscall(SYS_gettid);
+
+	lock_guard<std::mutex> lock(mutex);
+	events.push_back(move(ev));
+}
+
+/*
+ * Writes the events collected so far into the trace file.
+ */
+bool Trace::save()
+{
+	lock_guard<std::mutex> lock(mutex);
+	ofstream out(file, ios::trunc);
+
+	if (!out)
+	{
+		cerr << "Error creating trace file " << file << "!" << endl;
+		return false;
+	}
+
+	long pid = getpid();
+	out << "{\"traceEvents\": [";
+
+	for (size_t i = 0; i < events.size(); ++i)
+	{
+		const EVENT& ev = events[i];
+		out << (i ? "," : "") << "\n  {\"name\": \"" << phaseName(ev.phase) << "\", \"cat\": \"fsfreader\", \"ph\": \"X\", \"ts\": " << ev.start
+			<< ", \"dur\": " << ev.duration << ", \"pid\": " << pid << ", \"tid\": " << ev.tid;
+
+		if (!ev.label.empty())
+			out << ", \"args\": {\"file\": " << PanelIndex::jsonString(ev.label) << "}";
+
+		out << "}";
+	}
+
+	out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+	out.close();
+
+	if (!out)
+	{
+		cerr << "Error writing trace file " << file << "!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+const char *Trace::phaseName(TRACE_PHASE phase)
+{
+	switch (phase)
+	{
+		case TRACE_INDEX:		return "index";
+		case TRACE_READ:		return "read";
+		case TRACE_DECODE:		return "decode";
+		case TRACE_INFLATE:		return "inflate";
+		case TRACE_AES_INIT:	return "aes-init";
+		case TRACE_DECRYPT:		return "decrypt";
+		case TRACE_WRITE:		return "write";
+	}
+
+	return "unknown";
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+// Static probes for perf and bpftrace. They are a single nop while no tool
+// is attached. Without <sys/sdt.h> they are left out.
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define TRACE_PROBE(name, phase, label)	DTRACE_PROBE3(fsfreader, name, phase, (label).data(), (label).length())
+#else
+#define TRACE_PROBE(name, phase, label)
+#endif
+
+namespace reader
+{
+	typedef enum
+	{
+		TRACE_INDEX,		// Reading or scanning the index
+		TRACE_READ,			// Reading the chain of an entry
+		TRACE_DECODE,		// Decoding an entry
+		TRACE_INFLATE,		// Expand::unzip()
+		TRACE_AES_INIT,		// Scramble::aesInit()
+		TRACE_DECRYPT,		// Scramble::aesDecodeBuffer()
+		TRACE_WRITE			// Writing an output file
+	}TRACE_PHASE;
+
+	/**
+	 * Collects the phases of a run and writes them as Chrome trace events
+	 * (JSON), which can be loaded into Perfetto or chrome://tracing. Every
+	 * phase is a complete event on the thread it ran on; the entry it
+	 * belongs to is an argument of the event. The file is written when the
+	 * object is destroyed.
+	 *
+	 * Thread safety: add() may be called by several threads at the same
+	 * time. OPTIONS holds a pointer to the object; it is nullptr if
+	 * tracing is off.
+	 */
+	class Trace
+	{
+		struct EVENT
+		{
+			TRACE_PHASE phase;
+			std::string label;
+			int64_t start;			// Microseconds since the object was created
+			int64_t duration;
+			long tid;
+		};
+
+		std::string file;
+		std::mutex mutex;
+		std::vector<EVENT> events;
+		std::chrono::steady_clock::time_point origin;
+
+		public:
+			explicit Trace(const std::string& f)
+				: file{f},
+				  origin{std::chrono::steady_clock::now()}
+			{}
+
+			~Trace();
+
+			void add(TRACE_PHASE phase, std::string_view label, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+			bool save();
+
+			static const char *phaseName(TRACE_PHASE phase);
+	};
+
+	/**
+	 * Measures a phase from its construction to its destruction. The
+	 * static probes "phase__begin" and "phase__end" fire in any case; the
+	 * clock is read only if a Trace is given. \p label must live as long
+	 * as the object.
+	 */
+	class TraceScope
+	{
+		Trace *trace;
+		TRACE_PHASE phase;
+		std::string_view label;
+		std::chrono::steady_clock::time_point start;
+
+		public:
+			TraceScope(Trace *t, TRACE_PHASE p, std::string_view l = std::string_view())
+				: trace{t},
+				  phase{p},
+				  label{l}
+			{
+				TRACE_PROBE(phase__begin, phase, label);
+
+				if (trace)
+					start = std::chrono::steady_clock::now();
+			}
+
+			~TraceScope()
+			{
+				TRACE_PROBE(phase__end, phase, label);
+
+				if (trace)
+					trace->add(phase, label, start, std::chrono::steady_clock::now());
+			}
+
+			TraceScope(const TraceScope&) = delete;
+			TraceScope& operator=(const TraceScope&) = delete;
+	};
+}
+
+#endif
@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "transcode.h"
+#include "filter.h"
+#include "outdir.h"
+#include "parallel.h"
+#include "writer.h"
+
+namespace fs = std::filesystem;
+using namespace reader;
+using namespace std;
+
+Transcode::~Transcode()
+{
+	if (fd >= 0)
+		::close(fd);
+}
+
+/*
+ * "tp4" selects compressed and "tp5" encrypted XML files.
+ */
+bool Transcode::codingFromString(const string& str, CODING& c)
+{
+	if (str.compare("tp4") == 0)
+		c = CODING_GZIP;
+	else if (str.compare("tp5") == 0)
+		c = CODING_AES;
+	else
+		return false;
+
+	return true;
+}
+
+bool Transcode::doTranscode()
+{
+	if (!archive.open() || !archive.readIndex())
+		return false;
+
+	// A copy of a damaged index would silently lack the entries behind
+	// the damage.
+	if (archive.indexTruncated())
+	{
+		cerr << "The index of " << archive.getFileName() << " is damaged and some files would be missing! Use --scan to recover them." << endl;
+		return false;
+	}
+
+	error_code ec;
+
+	if (fs::equivalent(archive.getFileName(), target, ec))
+	{
+		cerr << "The target file " << target << " must not be the source file!" << endl;
+		return false;
+	}
+
+	const vector<struct INDEX *>& entries = archive.getEntries();
+	size_t num = entries.size();
+
+	// The new file is written under a temporary name beside the target
+	// and renamed when it is complete. A failed or interrupted run leaves
+	// an existing target untouched.
+	string tmp = target + ".tmp." + to_string(getpid());
+	fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+	if (fd < 0)
+	{
+		cerr << "Error creating file " << tmp << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	// Block 0 and the index come first. They are written at the end when
+	// the positions of all chains are known. The data blocks follow them.
+	nextFree = num + 1;
+	buffer.resize(WRITER_BUFFER_SIZE);
+	fill = 0;
+	bool ok = lseek(fd, Archive::calcBlockPos(nextFree), SEEK_SET) >= 0;
+	bool converted = true;
+
+	vector<struct USAGE_BLOCK> index(num);
+	size_t numRecoded = 0;
+
+	// The XML files of a batch are decoded and encoded in parallel and
+	// written in the order of the index by this thread, so only one batch
+	// is held in memory.
+	for (size_t b = 0; ok && converted && b < num; b += TRANSCODE_BATCH)
+	{
+		size_t count = min((size_t)TRANSCODE_BATCH, num - b);
+		vector<string> data(count);
+		vector<char> recoded(count, 0);
+		vector<char> failed(count, 0);
+
+		parallelFor(count, [&](size_t j)
+		{
+			const struct USAGE_BLOCK *ub = entries[b + j]->ublock;
+			string raw, plain;
+
+			if (coding == CODING_PLAIN || EntryFilter::entryType(ub->filePath) != TYPE_XML)
+				return;
+
+			if (!archive.readChain(ub, raw))
+			{
+				failed[j] = 1;
+				return;
+			}
+
+			CODING from = Archive::detectCoding(ub->filePath, reinterpret_cast<const unsigned char *>(raw.data()), raw.length());
+
+			if (from == coding)
+				return;
+
+			if (!archive.decode(from, raw, plain, true) || !archive.encode(coding, plain, data[j]))
+				failed[j] = 1;
+			else
+				recoded[j] = 1;
+		}, threads);
+
+		for (size_t j = 0; j < count; ++j)
+		{
+			if (failed[j])
+			{
+				cerr << "ERROR: " << entries[b + j]->ublock->filePath << ": Could not be converted!" << endl;
+				converted = false;
+			}
+		}
+
+		for (size_t j = 0; ok && converted && j < count; ++j)
+		{
+			size_t i = b + j;
+			struct USAGE_BLOCK& ub = index[i];
+			ub = *entries[i]->ublock;
+			ub.thisBlock = i + 1;
+			ub.prevBlock = i;
+			ub.nextBlock = (i + 1 < num) ? i + 2 : 0;
+
+			if (archive.getOptions().verbose)
+				cout << (recoded[j] ? "Converting " : "Copying ") << ub.filePath << endl;
+
+			if (recoded[j])
+			{
+				ok = writeData(data[j], ub);
+				string().swap(data[j]);
+				numRecoded++;
+			}
+			else
+				ok = copyChain(entries[i]->ublock, ub);
+		}
+	}
+
+	if (converted && (!ok || !flush() || !writeIndex(index)))
+	{
+		cerr << "Error writing file " << tmp << ": " << strerror(errno) << endl;
+		ok = false;
+	}
+
+	if (::close(fd) != 0 && converted && ok)
+	{
+		cerr << "Error writing file " << tmp << ": " << strerror(errno) << endl;
+		ok = false;
+	}
+
+	fd = -1;
+
+	if (converted && ok && rename(tmp.c_str(), target.c_str()) != 0)
+	{
+		cerr << "Error renaming " << tmp << " to " << target << ": " << strerror(errno) << endl;
+		ok = false;
+	}
+
+	if (!converted || !ok)
+	{
+		unlink(tmp.c_str());
+		return false;
+	}
+
+	cout << "Wrote " << num << " entries (" << numRecoded << " converted) in " << nextFree << " blocks to " << target << "." << endl;
+	return true;
+}
+
+/*
+ * Writes \p data as a new chain of blocks and sets the position and size
+ * of the chain in \p ub.
+ */
+bool Transcode::writeData(const string& data, struct USAGE_BLOCK& ub)
+{
+	uint32_t blocks = (data.length() + SIZE_PAYLOAD - 1) / SIZE_PAYLOAD;
+	ub.startBlock = blocks ? nextFree : 0;
+	ub.sizeBlocks = blocks;
+	ub.sizeBytes = data.length();
+
+	for (uint32_t i = 0; i < blocks; ++i)
+	{
+		size_t pos = (size_t)i * SIZE_PAYLOAD;
+		size_t len = min((size_t)SIZE_PAYLOAD, data.length() - pos);
+		uint32_t prev = i ? nextFree - 1 : 0;
+		uint32_t next = (i + 1 < blocks) ? nextFree + 1 : 0;
+
+		if (!putBlock(prev, next, data.data() + pos, len))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Copies the payload of the chain of \p src unchanged. Only the block
+ * numbers are changed because the chain gets a new position.
+ */
+bool Transcode::copyChain(const struct USAGE_BLOCK *src, struct USAGE_BLOCK& ub)
+{
+	unsigned char memblock[SIZE_BLOCK] = {0};
+	BlockView block(memblock);
+	uint32_t nextBlock = src->startBlock;
+	size_t bytes = 0;
+
+	ub.startBlock = src->sizeBlocks ? nextFree : 0;
+
+	for (uint32_t i = 0; i < src->sizeBlocks; ++i)
+	{
+		if (!archive.readBlock(nextBlock, memblock))
+			return false;
+
+		ByteSpan payload = block.payload();
+		uint32_t prev = i ? nextFree - 1 : 0;
+		uint32_t next = (i + 1 < src->sizeBlocks) ? nextFree + 1 : 0;
+
+		if (!putBlock(prev, next, payload.chars(), payload.size))
+			return false;
+
+		bytes += payload.size;
+		nextBlock = archive.nextLink(block);
+	}
+
+	ub.sizeBytes = bytes;
+	return true;
+}
+
+bool Transcode::putBlock(uint32_t prev, uint32_t next, const char *data, size_t len)
+{
+	unsigned char memblock[SIZE_BLOCK] = {0};
+
+	storeLE32(memblock + layout::THIS_BLOCK, nextFree);
+	storeLE32(memblock + layout::PREV_BLOCK, prev);
+	storeLE32(memblock + layout::NEXT_BLOCK, next);
+	storeLE16(memblock + layout::BYTES_USED, len);
+	memcpy(memblock + layout::DATA, data, len);
+	nextFree++;
+	return emit(memblock, SIZE_BLOCK);
+}
+
+/*
+ * Writes the file header, block 0 and the index blocks in front of the
+ * data blocks.
+ */
+bool Transcode::writeIndex(const vector<struct USAGE_BLOCK>& index)
+{
+	vector<unsigned char> head(SIZE_HEADER + (index.size() + 1) * SIZE_BLOCK, 0);
+
+	memcpy(head.data(), "\0FSFILE\0", 8);
+	storeLE32(head.data() + 8, index.empty() ? 0 : 1);
+
+	// Block 0 is taken over from the source file.
+	if (!archive.readBlock(0, head.data() + SIZE_HEADER))
+		return false;
+
+	for (size_t i = 0; i < index.size(); ++i)
+		Archive::storeUsageBlock(head.data() + Archive::calcBlockPos(i + 1), index[i]);
+
+	const unsigned char *buf = head.data();
+	size_t len = head.size();
+	off_t offset = 0;
+
+	while (len > 0)
+	{
+		ssize_t w = pwrite(fd, buf, len, offset);
+
+		if (w < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		buf += w;
+		len -= w;
+		offset += w;
+	}
+
+	return true;
+}
+
+bool Transcode::emit(const unsigned char *buf, size_t len)
+{
+	if (fill + len > buffer.size() && !flush())
+		return false;
+
+	memcpy(buffer.data() + fill, buf, len);
+	fill += len;
+	return true;
+}
+
+bool Transcode::flush()
+{
+	if (!fill)
+		return true;
+
+	bool ret = OutputDir::writeAll(fd, reinterpret_cast<const char *>(buffer.data()), fill);
+	fill = 0;
+	return ret;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+#ifndef __TRANSCODE_H__
+#define __TRANSCODE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "archive.h"
+
+#define TRANSCODE_BATCH		64				// XML files converted in parallel before they are written
+
+namespace reader
+{
+	/**
+	 * Converts an FSF file from TP5 (encrypted XML files) to TP4 (compressed
+	 * XML files) or the other way around. The XML files are read, decoded and
+	 * encoded again in memory in parallel, TRANSCODE_BATCH entries at a
+	 * time. The chains of all other files are copied block by block. The
+	 * new file is written in one pass under a temporary name and renamed
+	 * to the target when it is complete, so an existing target is only
+	 * replaced by a complete file.
+	 * Every chain of the new file is stored in consecutive blocks behind
+	 * the index and unused blocks are dropped. With CODING_PLAIN nothing
+	 * is converted and the file is only defragmented.
+	 */
+	class Transcode
+	{
+		Archive archive;
+		std::string target;
+		CODING coding{CODING_GZIP};		// CODING_PLAIN: Keep all entries as they are
+		unsigned threads{0};
+		int fd{-1};
+		uint32_t nextFree{0};
+		std::vector<unsigned char> buffer;
+		size_t fill{0};
+
+		public:
+			Transcode(const std::string& fn, const std::string& tg, const OPTIONS& opts = OPTIONS())
+				: archive{fn, opts},
+				  target{tg}
+			{}
+
+			~Transcode();
+
+			bool doTranscode();
+			void setCoding(CODING c) { coding = c; }
+			void setThreads(unsigned t) { threads = t; }
+
+			static bool codingFromString(const std::string& str, CODING& c);
+
+		private:
+			bool writeData(const std::string& data, struct USAGE_BLOCK& ub);
+			bool copyChain(const struct USAGE_BLOCK *src, struct USAGE_BLOCK& ub);
+			bool putBlock(uint32_t prev, uint32_t next, const char *data, size_t len);
+			bool writeIndex(const std::vector<struct USAGE_BLOCK>& index);
+			bool emit(const unsigned char *buf, size_t len);
+			bool flush();
+	};
+}
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <algorithm>
+
+#include "verify.h"
+#include "parallel.h"
+#include "scramble.h"
+#include "expand.h"
+#include "crc32.h"
+
+using namespace reader;
+using namespace std;
+
+bool Verify::doVerify()
+{
+	if (!archive.open() || !archive.readIndex())
+		return false;
+
+	uint32_t numBlocks = archive.getNumBlocks();
+	bitmapWords = (numBlocks + 63) / 64;
+	bitmap.reset(new atomic<uint64_t>[bitmapWords]);
+
+	for (size_t i = 0; i < bitmapWords; ++i)
+		bitmap[i].store(0, memory_order_relaxed);
+
+	// Block 0 and the index blocks are owned by the file system itself.
+	claimBlock(0);
+	const vector<struct INDEX *>& entries = archive.getEntries();
+	vector<vector<string>> errors(entries.size() + 1);
+
+	if (archive.indexTruncated())
+		errors[entries.size()].push_back("The chain of index blocks is broken after " + to_string(entries.size()) + " entries");
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		if (!claimBlock(entries[i]->ublock->thisBlock))
+			errors[entries.size()].push_back("Index block " + to_string(entries[i]->ublock->thisBlock) + " is used twice");
+	}
+
+	parallelFor(entries.size(), [&](size_t i)
+	{
+		verifyEntry(entries[i]->ublock, errors[i]);
+	}, threads);
+
+	size_t numErrors = 0;
+
+	for (size_t i = 0; i < errors.size(); ++i)
+	{
+		string name = (i < entries.size()) ? string(entries[i]->ublock->filePath) : string("index");
+
+		for (auto itr = errors[i].begin(); itr != errors[i].end(); ++itr)
+			cout << "ERROR: " << name << ": " << *itr << endl;
+
+		if (errors[i].empty() && i < entries.size() && archive.getOptions().verbose)
+			cout << "OK: " << name << endl;
+
+		numErrors += errors[i].size();
+	}
+
+	uint32_t unused = 0;
+
+	for (uint32_t b = 0; b < numBlocks; ++b)
+	{
+		if (!isClaimed(b))
+			unused++;
+	}
+
+	if (archive.getOptions().verbose)
+		cout << "CRC32 of gzip data calculated with " << Crc32::implementation() << "." << endl;
+
+	cout << "Verified " << entries.size() << " entries in " << numBlocks << " blocks: "
+		 << numErrors << " errors, " << unused << " unreferenced blocks." << endl;
+
+	return numErrors == 0;
+}
+
+/*
+ * Marks the block \p block as used. Returns FALSE if it was used already.
+ */
+bool Verify::claimBlock(uint32_t block)
+{
+	uint64_t mask = 1ULL << (block % 64);
+	uint64_t old = bitmap[block / 64].fetch_or(mask, memory_order_relaxed);
+	return (old & mask) == 0;
+}
+
+bool Verify::isClaimed(uint32_t block)
+{
+	return (bitmap[block / 64].load(memory_order_relaxed) & (1ULL << (block % 64))) != 0;
+}
+
+void Verify::verifyEntry(const struct USAGE_BLOCK *ub, vector<string>& errors)
+{
+	unsigned char memblock[SIZE_BLOCK] = {0};
+	BlockView block(memblock);
+	vector<uint32_t> visited;
+	string name(ub->filePath);
+	string data;
+	uint32_t numBlocks = archive.getNumBlocks();
+	uint32_t nextBlock = ub->startBlock;
+	uint32_t prevBlock = 0;
+	size_t bytes = 0;
+	CODING coding = CODING_PLAIN;
+
+	if (name.empty() || name.length() >= layout::FILE_PATH_LEN)
+		errors.push_back("Invalid file name");
+
+	if (ub->sizeBlocks < (ub->sizeBytes + SIZE_PAYLOAD - 1) / SIZE_PAYLOAD)
+		errors.push_back("Entry has " + to_string(ub->sizeBlocks) + " blocks but " + to_string(ub->sizeBytes) + " bytes");
+
+	for (uint32_t i = 0; i < ub->sizeBlocks; i++)
+	{
+		string pos = "block " + to_string(i) + " (" + to_string(nextBlock) + "): ";
+
+		if (nextBlock == 0 || nextBlock >= numBlocks)
+		{
+			errors.push_back(pos + "Block number is out of range");
+			return;
+		}
+
+		if (!claimBlock(nextBlock))
+		{
+			if (find(visited.begin(), visited.end(), nextBlock) != visited.end())
+				errors.push_back(pos + "Chain has a cycle");
+			else
+				errors.push_back(pos + "Block is cross-linked with another chain or the index");
+
+			return;
+		}
+
+		visited.push_back(nextBlock);
+
+		if (!archive.readBlock(nextBlock, memblock))
+		{
+			errors.push_back(pos + "Block can't be read");
+			return;
+		}
+
+		if (block.thisBlock() != nextBlock)
+			errors.push_back(pos + "thisBlock is " + to_string(block.thisBlock()));
+
+		if (i > 0 && block.prevBlock() != prevBlock)
+			errors.push_back(pos + "prevBlock is " + to_string(block.prevBlock()) + " instead of " + to_string(prevBlock));
+
+		if (block.bytesUsed() > SIZE_PAYLOAD)
+			errors.push_back(pos + "bytesUsed is " + to_string(block.bytesUsed()));
+
+		if (i + 1 == ub->sizeBlocks && block.nextBlock() != 0)
+			errors.push_back(pos + "Last block points to block " + to_string(block.nextBlock()));
+
+		if (i + 1 < ub->sizeBlocks && block.nextBlock() == 0)
+		{
+			errors.push_back(pos + "Chain ends after " + to_string(i + 1) + " of " + to_string(ub->sizeBlocks) + " blocks");
+			return;
+		}
+
+		ByteSpan payload = block.payload();
+
+		if (i == 0)
+			coding = Archive::detectCoding(name, block.rawPayload().data, SIZE_PAYLOAD);
+
+		if (coding != CODING_PLAIN)
+			data.append(payload.chars(), payload.size);
+
+		bytes += payload.size;
+		prevBlock = nextBlock;
+		nextBlock = block.nextBlock();
+	}
+
+	if (bytes != ub->sizeBytes)
+		errors.push_back("Sum of used bytes is " + to_string(bytes) + " but the size is " + to_string(ub->sizeBytes));
+
+	if (coding != CODING_PLAIN)
+		verifyPayload(name, coding, data, errors);
+}
+
+void Verify::verifyPayload(const string&, CODING coding, const string& data, vector<string>& errors)
+{
+	string out;
+
+	if (coding == CODING_GZIP)
+	{
+		// The gzip stream is inflated and its CRC32 and size are compared
+		// with the trailer. The decompressed data is not kept.
+		Expand exp;
+		exp.setQuiet(true);
+
+		if (exp.check(reinterpret_cast<const unsigned char *>(data.data()), data.length()) != 0)
+			errors.push_back("Damaged gzip data: " + exp.getError());
+	}
+	else if (coding == CODING_AES && (data.length() == 0 || (data.length() % AES128_KEY_SIZE) != 0))
+		errors.push_back("Encrypted size " + to_string(data.length()) + " is no multiple of the AES block size");
+	else if (!archive.decode(coding, data, out, true))
+		errors.push_back("Invalid AES padding (damaged data or wrong password/salt)");
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __VERIFY_H__
+#define __VERIFY_H__
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+#include "archive.h"
+
+namespace reader
+{
+	/**
+	 * Checks the integrity of an FSF file without writing anything. All
+	 * block chains are followed in parallel. Every block is claimed in an
+	 * atomic bitmap. A block claimed twice is either part of a cycle or it
+	 * belongs to more than one chain. Compressed and encrypted entries are
+	 * decoded into memory to check the gzip stream and the AES padding.
+	 */
+	class Verify
+	{
+		Archive archive;
+		unsigned threads{0};
+		std::unique_ptr<std::atomic<uint64_t>[]> bitmap;
+		size_t bitmapWords{0};
+
+		public:
+			explicit Verify(const std::string& fn, const OPTIONS& opts = OPTIONS())
+				: archive{fn, opts}
+			{}
+
+			bool doVerify();
+			void setThreads(unsigned t) { threads = t; }
+
+		private:
+			bool claimBlock(uint32_t block);
+			bool isClaimed(uint32_t block);
+			void verifyEntry(const struct USAGE_BLOCK *ub, std::vector<std::string>& errors);
+			void verifyPayload(const std::string& name, CODING coding, const std::string& data, std::vector<std::string>& errors);
+	};
+}
+
+#endif
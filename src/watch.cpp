@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <filesystem>
+
+#include <poll.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+#include "outdir.h"
+#include "parallel.h"
+#include "hash.h"
+
+namespace fs = std::filesystem;
+using namespace reader;
+using namespace std;
+
+Watch::~Watch()
+{
+	if (fd >= 0)
+		::close(fd);
+}
+
+/*
+ * Runs until an error occurs. The archives already in the directory are
+ * brought up to date first.
+ */
+bool Watch::doWatch()
+{
+	fd = inotify_init1(IN_CLOEXEC);
+
+	if (fd < 0 || inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		cerr << "Error watching directory " << dir << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	// The watch is set before the directory is read, so no file saved in
+	// between is missed.
+	error_code ec;
+
+	for (auto& de : fs::directory_iterator(dir, ec))
+	{
+		if (de.is_regular_file() && isArchive(de.path().filename().string()))
+			update(de.path().filename().string());
+	}
+
+	if (ec)
+	{
+		cerr << "Error reading directory " << dir << ": " << ec.message() << endl;
+		return false;
+	}
+
+	cout << "Watching " << dir << " ..." << endl;
+
+	typedef chrono::steady_clock CLOCK;
+	map<string, CLOCK::time_point> pending;		// File --> time to read it
+	alignas(struct inotify_event) char buf[4096];
+
+	while (true)
+	{
+		int timeout = -1;
+
+		for (auto itr = pending.begin(); itr != pending.end(); ++itr)
+		{
+			int ms = max(0, (int)chrono::duration_cast<chrono::milliseconds>(itr->second - CLOCK::now()).count());
+			timeout = (timeout < 0) ? ms : min(timeout, ms);
+		}
+
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		int ret = poll(&pfd, 1, timeout);
+
+		if (ret < 0 && errno != EINTR)
+		{
+			cerr << "Error waiting for changes in " << dir << ": " << strerror(errno) << endl;
+			return false;
+		}
+
+		if (ret > 0)
+		{
+			ssize_t len = read(fd, buf, sizeof(buf));
+
+			if (len < 0 && errno != EINTR && errno != EAGAIN)
+			{
+				cerr << "Error reading the events of " << dir << ": " << strerror(errno) << endl;
+				return false;
+			}
+
+			for (ssize_t pos = 0; pos < len; )
+			{
+				const struct inotify_event *ev = reinterpret_cast<const struct inotify_event *>(buf + pos);
+				pos += sizeof(struct inotify_event) + ev->len;
+
+				if (ev->len > 0 && isArchive(ev->name))
+					pending[ev->name] = CLOCK::now() + chrono::milliseconds(WATCH_SETTLE_MS);
+			}
+		}
+
+		for (auto itr = pending.begin(); itr != pending.end(); )
+		{
+			if (itr->second > CLOCK::now())
+			{
+				++itr;
+				continue;
+			}
+
+			update(itr->first);
+			itr = pending.erase(itr);
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Extracts the changed entries of the archive \p file into its output
+ * directory and removes the files of deleted entries.
+ */
+bool Watch::update(const string& file)
+{
+	auto start = chrono::steady_clock::now();
+	Archive archive(dir + "/" + file, opts);
+
+	if (!archive.open() || !archive.readIndex())
+		return false;
+
+	const vector<struct INDEX *>& entries = archive.getEntries();
+	size_t num = entries.size();
+	vector<uint64_t> digests(num);
+	vector<char> failed(num, 0);
+	vector<char> undecoded(num, 0);
+
+	parallelFor(num, [&](size_t i)
+	{
+		if (!digestEntry(archive, entries[i]->ublock, digests[i]))
+			failed[i] = 1;
+	}, threads);
+
+	string root = target + "/" + fs::path(file).stem().string();
+	string stateFile = root + "/" + WATCH_STATE;
+	error_code ec;
+	fs::create_directories(root, ec);
+	OutputDir out(root);
+
+	if (!out.open())
+		return false;
+
+	STATE oldState, newState;
+	loadState(stateFile, oldState);
+	vector<size_t> changed;
+	vector<string> dirs(num), names(num);
+
+	for (size_t i = 0; i < num; ++i)
+	{
+		const struct USAGE_BLOCK *ub = entries[i]->ublock;
+		names[i].assign(opts.transfer ? ub->utf8Path : ub->filePath);
+		dirs[i] = opts.transfer ? EntryFilter::typeDirectory(EntryFilter::entryType(names[i])) : string();
+		string rel = dirs[i].empty() ? names[i] : dirs[i] + "/" + names[i];
+
+		// An entry which can't be read is tried again with the next change.
+		if (failed[i])
+		{
+			newState[rel] = 0;
+			continue;
+		}
+
+		auto itr = oldState.find(rel);
+
+		if (itr == oldState.end() || itr->second != digests[i])
+			changed.push_back(i);
+		else
+			newState[rel] = digests[i];
+	}
+
+	unique_ptr<OutputWriter> writer(OutputWriter::create(writerType, out));
+	size_t numWritten = 0;
+
+	// The changed entries are decoded in parallel and written in the order
+	// of the index by this thread.
+	for (size_t b = 0; b < changed.size(); b += WATCH_BATCH)
+	{
+		size_t count = min((size_t)WATCH_BATCH, changed.size() - b);
+		vector<string> data(count);
+
+		parallelFor(count, [&](size_t j)
+		{
+			size_t i = changed[b + j];
+			const struct USAGE_BLOCK *ub = entries[i]->ublock;
+			string raw, decoded;
+
+			if (!archive.readChain(ub, raw))
+			{
+				failed[i] = 1;
+				return;
+			}
+
+			CODING coding = Archive::detectCoding(ub->filePath, reinterpret_cast<const unsigned char *>(raw.data()), raw.length());
+
+			// As in an extraction, an entry which can't be decoded is
+			// written as it is stored. It is tried again with the next
+			// change.
+			if (coding != CODING_PLAIN && archive.decode(coding, raw, decoded))
+				data[j].swap(decoded);
+			else
+			{
+				if (coding != CODING_PLAIN)
+				{
+					cerr << "WARNING: File " << out.path(dirs[i], names[i]) << " was not decoded!" << endl;
+					undecoded[i] = 1;
+				}
+
+				data[j].swap(raw);
+			}
+		}, threads);
+
+		for (size_t j = 0; j < count; ++j)
+		{
+			size_t i = changed[b + j];
+			string rel = dirs[i].empty() ? names[i] : dirs[i] + "/" + names[i];
+
+			if (failed[i])
+			{
+				newState[rel] = 0;
+				continue;
+			}
+
+			writer->setModifyTime(entries[i]->ublock->tmModify);
+
+			if (!writer->writeFile(dirs[i], names[i], data[j].data(), data[j].length()))
+			{
+				cerr << "Error writing target file " << out.path(dirs[i], names[i]) << "!" << endl;
+				newState[rel] = 0;
+				continue;
+			}
+
+			newState[rel] = undecoded[i] ? 0 : digests[i];
+			numWritten++;
+		}
+	}
+
+	if (!writer->finish())
+		return false;
+
+	// Files of entries no longer in the archive are removed.
+	size_t numRemoved = 0;
+
+	for (auto itr = oldState.begin(); itr != oldState.end(); ++itr)
+	{
+		if (newState.find(itr->first) == newState.end() && fs::remove(root + "/" + itr->first, ec))
+			numRemoved++;
+	}
+
+	if (!saveState(stateFile, newState))
+		return false;
+
+	auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+	cout << file << ": " << numWritten << " of " << num << " files written, " << numRemoved << " removed (" << ms << " ms)." << endl;
+	return true;
+}
+
+/*
+ * The digest covers the metadata of the entry and the raw payload of its
+ * whole chain. The data is only read, not decoded. The position of the
+ * chain is left out, because it changes when an archive is saved again
+ * without changing the entry. The layout is part of it, and for an
+ * encrypted entry the password and the salt, so an entry is written
+ * again when the options change.
+ */
+bool Watch::digestEntry(Archive& archive, const struct USAGE_BLOCK *ub, uint64_t& digest)
+{
+	Hash64 hash(1);
+	hash.update(ub->filePath.data(), ub->filePath.length());
+	hash.update32((uint32_t)ub->tmCreate);
+	hash.update32((uint32_t)ub->tmModify);
+	hash.update32(ub->flags);
+	hash.update32(ub->sizeBlocks);
+	hash.update32(ub->sizeBytes);
+	hash.update32(opts.transfer);
+
+	// The sizes are not trusted, as in Archive::readChain().
+	if (ub->sizeBlocks > archive.getNumBlocks())
+		return false;
+
+	unsigned char memblock[SIZE_BLOCK] = {0};
+	BlockView block(memblock);
+	uint32_t nextBlock = ub->startBlock;
+
+	for (uint32_t i = 0; i < ub->sizeBlocks; ++i)
+	{
+		if (!archive.readBlock(nextBlock, memblock))
+			return false;
+
+		ByteSpan payload = block.payload();
+		hash.update(payload.data, payload.size);
+
+		if (i == 0 && Archive::detectCoding(ub->filePath, payload.data, payload.size) == CODING_AES)
+		{
+			hash.update(opts.password);
+			hash.update(opts.salt);
+		}
+
+		nextBlock = archive.nextLink(block);
+	}
+
+	// 0 marks an entry not written or not decoded.
+	digest = hash.digest() | 1;
+	return true;
+}
+
+bool Watch::isArchive(const string& name)
+{
+	string ext = fs::path(name).extension().string();
+	return strcasecmp(ext.c_str(), ".tp4") == 0 || strcasecmp(ext.c_str(), ".tp5") == 0;
+}
+
+/*
+ * Every line of the state file holds the digest of an entry and its path
+ * relative to the output directory, separated by a tab.
+ */
+bool Watch::loadState(const string& file, STATE& state)
+{
+	ifstream in(file);
+	string line;
+
+	if (!in)
+		return false;
+
+	while (getline(in, line))
+	{
+		size_t tab = line.find('\t');
+
+		if (tab != string::npos)
+			state[line.substr(tab + 1)] = strtoull(line.substr(0, tab).c_str(), nullptr, 16);
+	}
+
+	return true;
+}
+
+bool Watch::saveState(const string& file, const STATE& state)
+{
+	string tmp = file + ".tmp";
+
+	{
+		ofstream out(tmp, ios::trunc);
+
+		for (auto itr = state.begin(); itr != state.end(); ++itr)
+			out << Hash64::toString(itr->second) << "\t" << itr->first << "\n";
+
+		if (!out.flush())
+		{
+			cerr << "Error writing state file " << tmp << "!" << endl;
+			return false;
+		}
+	}
+
+	if (rename(tmp.c_str(), file.c_str()) != 0)
+	{
+		cerr << "Error renaming " << tmp << " to " << file << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+#include <string>
+#include <map>
+#include <cstdint>
+
+#include "archive.h"
+#include "writer.h"
+
+#define WATCH_SETTLE_MS		100				// Quiet time after the last write before a file is read
+#define WATCH_BATCH			64				// Entries decoded in parallel before they are written
+#define WATCH_STATE			".fsfwatch"		// Name of the state file in every output directory
+
+namespace reader
+{
+	/**
+	 * Watches a directory with inotify and extracts every TP4 or TP5 file
+	 * saved into it. A file is read when it was closed after writing or
+	 * moved into the directory and no further event arrived for
+	 * WATCH_SETTLE_MS. Every archive gets its own output directory below
+	 * the target, named after the archive without its extension.
+	 *
+	 * Only changed entries are extracted. The output directory holds a
+	 * state file with a digest of the metadata and the stored data of
+	 * every entry written. Entries with the same digest are skipped, and
+	 * files of entries no longer in the archive are removed. As the state
+	 * is kept on disk, archives saved while the watch was not running are
+	 * updated the same way at the start.
+	 */
+	class Watch
+	{
+		typedef std::map<std::string, uint64_t> STATE;		// Output path --> digest
+
+		std::string dir;
+		std::string target{"."};
+		OPTIONS opts;
+		WRITER_TYPE writerType{WRITER_BUFFERED};
+		unsigned threads{0};
+		int fd{-1};
+
+		public:
+			Watch(const std::string& d, const std::string& tg, const OPTIONS& o = OPTIONS())
+				: dir{d},
+				  target{tg},
+				  opts{o}
+			{}
+
+			~Watch();
+
+			bool doWatch();
+			void setWriter(WRITER_TYPE type) { writerType = type; }
+			void setThreads(unsigned t) { threads = t; }
+
+		private:
+			bool update(const std::string& file);
+			bool digestEntry(Archive& archive, const struct USAGE_BLOCK *ub, uint64_t& digest);
+			static bool isArchive(const std::string& name);
+			static bool loadState(const std::string& file, STATE& state);
+			static bool saveState(const std::string& file, const STATE& state);
+	};
+}
+
+#endif
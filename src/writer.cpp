@@ -0,0 +1,593 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "writer.h"
+
+using namespace reader;
+using namespace std;
+
+#define TAR_BLOCK	512
+
+namespace
+{
+	struct TAR_HEADER		// POSIX ustar header
+	{
+		char name[100];
+		char mode[8];
+		char uid[8];
+		char gid[8];
+		char size[12];
+		char mtime[12];
+		char chksum[8];
+		char typeflag;
+		char linkname[100];
+		char magic[6];
+		char version[2];
+		char uname[32];
+		char gname[32];
+		char devmajor[8];
+		char devminor[8];
+		char prefix[155];
+		char pad[12];
+	};
+
+	static_assert(sizeof(TAR_HEADER) == TAR_BLOCK, "Wrong size of tar header");
+
+	class StopWatch
+	{
+		chrono::steady_clock::time_point start;
+		double& total;
+
+		public:
+			explicit StopWatch(double& t)
+				: start{chrono::steady_clock::now()},
+				  total{t}
+			{}
+
+			~StopWatch()
+			{
+				total += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			}
+	};
+}
+
+OutputWriter::~OutputWriter()
+{
+	if (mFd >= 0)
+		::close(mFd);
+}
+
+OutputWriter *OutputWriter::create(WRITER_TYPE type, OutputDir& od)
+{
+	switch(type)
+	{
+		case WRITER_PREALLOC:	return new PreallocWriter(od);
+		case WRITER_MMAP:		return new MmapWriter(od);
+		case WRITER_TMPFILE:	return new TmpfileWriter(od);
+		default:
+			return new BufferedWriter(od);
+	}
+}
+
+bool OutputWriter::typeFromString(const string& str, WRITER_TYPE& type)
+{
+	if (str.compare("buffered") == 0)
+		type = WRITER_BUFFERED;
+	else if (str.compare("prealloc") == 0)
+		type = WRITER_PREALLOC;
+	else if (str.compare("mmap") == 0)
+		type = WRITER_MMAP;
+	else if (str.compare("tmpfile") == 0)
+		type = WRITER_TMPFILE;
+	else
+		return false;
+
+	return true;
+}
+
+bool OutputWriter::open(const string& dir, const string& name, size_t sizeHint)
+{
+	StopWatch sw(stats.seconds);
+	mDir = dir;
+	mName = name;
+	return doOpen(sizeHint);
+}
+
+bool OutputWriter::write(const char *buf, size_t len)
+{
+	if (!len)
+		return true;
+
+	StopWatch sw(stats.seconds);
+
+	if (!doWrite(buf, len))
+	{
+		cerr << "Error writing to file " << outDir.path(mDir, mName) << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	stats.bytes += len;
+	return true;
+}
+
+bool OutputWriter::close()
+{
+	StopWatch sw(stats.seconds);
+	bool ret = doClose();
+
+	if (mFd >= 0)
+		::close(mFd);
+
+	mFd = -1;
+
+	if (ret)
+		stats.files++;
+
+	return ret;
+}
+
+bool OutputWriter::writeFile(const string& dir, const string& name, const char *buf, size_t len)
+{
+	if (!open(dir, name, len))
+		return false;
+
+	if (!write(buf, len))
+	{
+		close();
+		return false;
+	}
+
+	return close();
+}
+
+void OutputWriter::printStats()
+{
+	double mb = static_cast<double>(stats.bytes) / (1024.0 * 1024.0);
+	cout << "Writer " << getName() << ": " << stats.files << " files, " << stats.bytes << " bytes in "
+		 << fixed << setprecision(3) << stats.seconds << " s";
+
+	if (stats.seconds > 0.0)
+		cout << " (" << setprecision(1) << (mb / stats.seconds) << " MiB/s)";
+
+	cout << defaultfloat << endl;
+}
+
+/*
+ * Buffered writer: Collects the data in a large buffer and writes it with
+ * as few write() calls as possible.
+ */
+bool BufferedWriter::doOpen(size_t)
+{
+	if (buffer.empty())
+		buffer.resize(WRITER_BUFFER_SIZE);
+
+	fill = 0;
+	mFd = outDir.createFile(mDir, mName);
+	return mFd >= 0;
+}
+
+bool BufferedWriter::doWrite(const char *buf, size_t len)
+{
+	if (fill + len > buffer.size())
+	{
+		if (!flush())
+			return false;
+
+		if (len >= buffer.size())
+			return OutputDir::writeAll(mFd, buf, len);
+	}
+
+	memcpy(buffer.data() + fill, buf, len);
+	fill += len;
+	return true;
+}
+
+bool BufferedWriter::doClose()
+{
+	return flush();
+}
+
+bool BufferedWriter::flush()
+{
+	if (!fill)
+		return true;
+
+	bool ret = OutputDir::writeAll(mFd, buffer.data(), fill);
+	fill = 0;
+	return ret;
+}
+
+/*
+ * Preallocating writer: Reserves the final size of the file with
+ * fallocate(), assembles the whole content in memory and writes it with
+ * pwrite() when the file is closed.
+ */
+bool PreallocWriter::doOpen(size_t sizeHint)
+{
+	assembled.clear();
+	assembled.reserve(sizeHint);
+	allocated = 0;
+	mFd = outDir.createFile(mDir, mName);
+
+	if (mFd < 0)
+		return false;
+
+	if (sizeHint > 0 && fallocate(mFd, 0, 0, sizeHint) == 0)
+		allocated = sizeHint;
+
+	return true;
+}
+
+bool PreallocWriter::doWrite(const char *buf, size_t len)
+{
+	assembled.append(buf, len);
+	return true;
+}
+
+bool PreallocWriter::doClose()
+{
+	const char *buf = assembled.data();
+	size_t len = assembled.length();
+	off_t offset = 0;
+
+	while (len > 0)
+	{
+		ssize_t w = pwrite(mFd, buf, len, offset);
+
+		if (w < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			cerr << "Error writing to file " << outDir.path(mDir, mName) << ": " << strerror(errno) << endl;
+			return false;
+		}
+
+		buf += w;
+		len -= w;
+		offset += w;
+	}
+
+	// The size hint may have been bigger than the real content.
+	if (allocated > assembled.length() && ftruncate(mFd, assembled.length()) != 0)
+		return false;
+
+	return true;
+}
+
+/*
+ * Memory mapped writer: Sets the size of the file with ftruncate(), maps
+ * it into memory and copies the data into the mapping.
+ */
+bool MmapWriter::doOpen(size_t sizeHint)
+{
+	pos = 0;
+	mFd = outDir.createFile(mDir, mName, true);
+
+	if (mFd < 0)
+		return false;
+
+	if (sizeHint > 0)
+		return map(sizeHint);
+
+	return true;
+}
+
+bool MmapWriter::doWrite(const char *buf, size_t len)
+{
+	if (pos + len > mapSize)
+	{
+		size_t size = mapSize ? mapSize * 2 : 4096;
+
+		while (size < pos + len)
+			size *= 2;
+
+		if (!map(size))
+			return false;
+	}
+
+	memcpy(mapped + pos, buf, len);
+	pos += len;
+	return true;
+}
+
+bool MmapWriter::doClose()
+{
+	unmap();
+
+	if (ftruncate(mFd, pos) != 0)
+	{
+		cerr << "Error truncating file " << outDir.path(mDir, mName) << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool MmapWriter::map(size_t size)
+{
+	unmap();
+
+	if (ftruncate(mFd, size) != 0)
+		return false;
+
+	void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+
+	if (addr == MAP_FAILED)
+		return false;
+
+	mapped = static_cast<char *>(addr);
+	mapSize = size;
+	return true;
+}
+
+void MmapWriter::unmap()
+{
+	if (mapped)
+		munmap(mapped, mapSize);
+
+	mapped = nullptr;
+	mapSize = 0;
+}
+
+/*
+ * Temporary file writer: Writes into an anonymous file created with
+ * O_TMPFILE. Only when the file is complete it is linked into the
+ * directory and renamed to its final name. A reader never sees a partial
+ * file. If the file system does not support O_TMPFILE, the file is
+ * written directly.
+ */
+bool TmpfileWriter::doOpen(size_t)
+{
+	if (buffer.empty())
+		buffer.resize(WRITER_BUFFER_SIZE);
+
+	fill = 0;
+	mDirFd = outDir.parentFd(mDir, mName, mBase);
+
+	if (mDirFd < 0)
+		return false;
+
+	mFd = openat(mDirFd, ".", O_TMPFILE | O_WRONLY | O_CLOEXEC, 0666);
+	mAnonymous = (mFd >= 0);
+
+	if (!mAnonymous)
+		mFd = outDir.createFile(mDir, mName);
+
+	return mFd >= 0;
+}
+
+bool TmpfileWriter::doWrite(const char *buf, size_t len)
+{
+	if (fill + len > buffer.size())
+	{
+		if (!flush())
+			return false;
+
+		if (len >= buffer.size())
+			return OutputDir::writeAll(mFd, buf, len);
+	}
+
+	memcpy(buffer.data() + fill, buf, len);
+	fill += len;
+	return true;
+}
+
+bool TmpfileWriter::doClose()
+{
+	if (!flush())
+		return false;
+
+	if (!mAnonymous)
+		return true;
+
+	string proc = "/proc/self/fd/" + to_string(mFd);
+	string tmp = "." + mBase + "." + to_string(getpid()) + ".tmp";
+	unlinkat(mDirFd, tmp.c_str(), 0);
+
+	if (linkat(AT_FDCWD, proc.c_str(), mDirFd, tmp.c_str(), AT_SYMLINK_FOLLOW) != 0)
+	{
+		cerr << "Error linking file " << outDir.path(mDir, mName) << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	if (renameat(mDirFd, tmp.c_str(), mDirFd, mBase.c_str()) != 0)
+	{
+		cerr << "Error renaming file " << outDir.path(mDir, mName) << ": " << strerror(errno) << endl;
+		unlinkat(mDirFd, tmp.c_str(), 0);
+		return false;
+	}
+
+	return true;
+}
+
+bool TmpfileWriter::flush()
+{
+	if (!fill)
+		return true;
+
+	bool ret = OutputDir::writeAll(mFd, buffer.data(), fill);
+	fill = 0;
+	return ret;
+}
+
+/*
+ * Tar writer: Every file becomes a header block followed by its content,
+ * padded to a multiple of 512 bytes. Subdirectories get their own entry
+ * before the first file in them. Paths longer than 100 characters are
+ * written with a GNU long name entry.
+ */
+TarWriter::~TarWriter()
+{
+	if (streamFd >= 0)
+		::close(streamFd);
+}
+
+bool TarWriter::openStream()
+{
+	if (streamFd >= 0)
+		return true;
+
+	streamFd = ::open(tarFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+	if (streamFd < 0)
+	{
+		cerr << "Error creating file " << tarFile << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool TarWriter::doOpen(size_t sizeHint)
+{
+	if (buffer.empty())
+		buffer.resize(WRITER_BUFFER_SIZE);
+
+	entry.clear();
+	entry.reserve(sizeHint);
+	return openStream();
+}
+
+bool TarWriter::doWrite(const char *buf, size_t len)
+{
+	entry.append(buf, len);
+	return true;
+}
+
+bool TarWriter::doClose()
+{
+	string dir = mDir;
+
+	if (!dir.empty() && dir[0] == '/')
+		dir.erase(0, 1);
+
+	if (!dir.empty() && dirsWritten.find(dir) == dirsWritten.end())
+	{
+		if (!putHeader(dir + "/", 0, '5'))
+			return false;
+
+		dirsWritten.insert(dir);
+	}
+
+	string name = dir.empty() ? mName : dir + "/" + mName;
+
+	if (!putHeader(name, entry.length(), '0') || !emit(entry.data(), entry.length()))
+		return false;
+
+	char zero[TAR_BLOCK] = {0};
+	size_t rest = entry.length() % TAR_BLOCK;
+
+	if (rest && !emit(zero, TAR_BLOCK - rest))
+		return false;
+
+	entry.clear();
+	return true;
+}
+
+bool TarWriter::finish()
+{
+	if (!openStream())
+		return false;
+
+	// The end of an archive is marked by two empty blocks.
+	char zero[TAR_BLOCK * 2] = {0};
+
+	if (!emit(zero, sizeof(zero)) || !flush())
+	{
+		cerr << "Error writing to file " << tarFile << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool TarWriter::putHeader(const string& name, size_t size, char type)
+{
+	TAR_HEADER hd;
+
+	if (name.length() > sizeof(hd.name))
+	{
+		// GNU extension: The name follows in the data of a pseudo entry.
+		string ln = name + '\0';
+		char zero[TAR_BLOCK] = {0};
+		size_t rest = ln.length() % TAR_BLOCK;
+
+		if (!putHeader("././@LongLink", ln.length(), 'L') || !emit(ln.data(), ln.length()) ||
+				(rest && !emit(zero, TAR_BLOCK - rest)))
+			return false;
+	}
+
+	memset(&hd, 0, sizeof(hd));
+	strncpy(hd.name, name.c_str(), sizeof(hd.name));
+	snprintf(hd.mode, sizeof(hd.mode), "%07o", type == '5' ? 0755 : 0644);
+	snprintf(hd.uid, sizeof(hd.uid), "%07o", 0);
+	snprintf(hd.gid, sizeof(hd.gid), "%07o", 0);
+	snprintf(hd.size, sizeof(hd.size), "%011lo", static_cast<unsigned long>(size));
+	snprintf(hd.mtime, sizeof(hd.mtime), "%011lo", static_cast<unsigned long>(mTime));
+	hd.typeflag = type;
+	memcpy(hd.magic, "ustar", 6);
+	memcpy(hd.version, "00", 2);
+	// The checksum is calculated with the checksum field set to blanks.
+	memset(hd.chksum, ' ', sizeof(hd.chksum));
+	unsigned sum = 0;
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(&hd);
+
+	for (size_t i = 0; i < sizeof(hd); ++i)
+		sum += p[i];
+
+	snprintf(hd.chksum, sizeof(hd.chksum), "%06o", sum);
+	return emit(reinterpret_cast<const char *>(&hd), sizeof(hd));
+}
+
+bool TarWriter::emit(const char *buf, size_t len)
+{
+	if (fill + len > buffer.size())
+	{
+		if (!flush())
+			return false;
+
+		if (len >= buffer.size())
+			return OutputDir::writeAll(streamFd, buf, len);
+	}
+
+	memcpy(buffer.data() + fill, buf, len);
+	fill += len;
+	return true;
+}
+
+bool TarWriter::flush()
+{
+	if (!fill)
+		return true;
+
+	bool ret = OutputDir::writeAll(streamFd, buffer.data(), fill);
+	fill = 0;
+	return ret;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+#include <string>
+#include <vector>
+#include <set>
+#include <cstddef>
+#include <ctime>
+
+#include "outdir.h"
+
+#define WRITER_BUFFER_SIZE	(1024 * 1024)
+
+namespace reader
+{
+	typedef enum
+	{
+		WRITER_BUFFERED,	// write() from a large buffer
+		WRITER_PREALLOC,	// fallocate() and one pwrite() of the assembled file
+		WRITER_MMAP,		// ftruncate() and mmap()
+		WRITER_TMPFILE		// O_TMPFILE and linkat() to publish the finished file
+	}WRITER_TYPE;
+
+	struct WRITER_STATS
+	{
+		size_t files{0};
+		size_t bytes{0};
+		double seconds{0.0};
+	};
+
+	/**
+	 * Base class of all output file writers. A file is written by calling
+	 * open(), write() as often as needed and finally close(). The time
+	 * spent in the writer and the number of bytes written are collected
+	 * so that the different backends can be compared.
+	 */
+	class OutputWriter
+	{
+		public:
+			explicit OutputWriter(OutputDir& od)
+				: outDir{od}
+			{}
+
+			virtual ~OutputWriter();
+
+			bool open(const std::string& dir, const std::string& name, size_t sizeHint);
+			bool write(const char *buf, size_t len);
+			bool close();
+			bool writeFile(const std::string& dir, const std::string& name, const char *buf, size_t len);
+			void setModifyTime(time_t t) { mTime = t; }
+			virtual bool finish() { return true; }
+
+			virtual const char *getName() = 0;
+			const WRITER_STATS& getStats() { return stats; }
+			void printStats();
+
+			static OutputWriter *create(WRITER_TYPE type, OutputDir& od);
+			static bool typeFromString(const std::string& str, WRITER_TYPE& type);
+
+		protected:
+			virtual bool doOpen(size_t sizeHint) = 0;
+			virtual bool doWrite(const char *buf, size_t len) = 0;
+			virtual bool doClose() = 0;
+
+			OutputDir& outDir;
+			std::string mDir;
+			std::string mName;
+			int mFd{-1};
+			time_t mTime{0};		// Modification time of the next file
+
+		private:
+			WRITER_STATS stats;
+	};
+
+	class BufferedWriter : public OutputWriter
+	{
+		public:
+			explicit BufferedWriter(OutputDir& od)
+				: OutputWriter(od)
+			{}
+
+			const char *getName() override { return "buffered"; }
+
+		protected:
+			bool doOpen(size_t sizeHint) override;
+			bool doWrite(const char *buf, size_t len) override;
+			bool doClose() override;
+
+		private:
+			bool flush();
+
+			std::vector<char> buffer;
+			size_t fill{0};
+	};
+
+	class PreallocWriter : public OutputWriter
+	{
+		public:
+			explicit PreallocWriter(OutputDir& od)
+				: OutputWriter(od)
+			{}
+
+			const char *getName() override { return "prealloc"; }
+
+		protected:
+			bool doOpen(size_t sizeHint) override;
+			bool doWrite(const char *buf, size_t len) override;
+			bool doClose() override;
+
+		private:
+			std::string assembled;
+			size_t allocated{0};
+	};
+
+	class MmapWriter : public OutputWriter
+	{
+		public:
+			explicit MmapWriter(OutputDir& od)
+				: OutputWriter(od)
+			{}
+
+			const char *getName() override { return "mmap"; }
+
+		protected:
+			bool doOpen(size_t sizeHint) override;
+			bool doWrite(const char *buf, size_t len) override;
+			bool doClose() override;
+
+		private:
+			bool map(size_t size);
+			void unmap();
+
+			char *mapped{nullptr};
+			size_t mapSize{0};
+			size_t pos{0};
+	};
+
+	class TmpfileWriter : public OutputWriter
+	{
+		public:
+			explicit TmpfileWriter(OutputDir& od)
+				: OutputWriter(od)
+			{}
+
+			const char *getName() override { return "tmpfile"; }
+
+		protected:
+			bool doOpen(size_t sizeHint) override;
+			bool doWrite(const char *buf, size_t len) override;
+			bool doClose() override;
+
+		private:
+			bool flush();
+
+			std::vector<char> buffer;
+			size_t fill{0};
+			int mDirFd{-1};
+			std::string mBase;
+			bool mAnonymous{false};		// TRUE if the file was created with O_TMPFILE
+	};
+
+	/**
+	 * Writes all files as one tar stream (POSIX ustar) into a single file
+	 * or to stdout instead of creating them one by one. Every file is
+	 * collected in memory because its size must be known for the header.
+	 * finish() must be called after the last file to write the end of the
+	 * archive.
+	 */
+	class TarWriter : public OutputWriter
+	{
+		public:
+			TarWriter(OutputDir& od, const std::string& file, int fd=-1)
+				: OutputWriter(od),
+				  tarFile{file},
+				  streamFd{fd}
+			{}
+
+			~TarWriter() override;
+
+			const char *getName() override { return "tar"; }
+			bool finish() override;
+
+		protected:
+			bool doOpen(size_t sizeHint) override;
+			bool doWrite(const char *buf, size_t len) override;
+			bool doClose() override;
+
+		private:
+			bool openStream();
+			bool putHeader(const std::string& name, size_t size, char type);
+			bool emit(const char *buf, size_t len);
+			bool flush();
+
+			std::string tarFile;
+			int streamFd{-1};
+			std::string entry;
+			std::set<std::string> dirsWritten;
+			std::vector<char> buffer;
+			size_t fill{0};
+	};
+}
+
+#endif
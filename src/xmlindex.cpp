@@ -0,0 +1,486 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include "xmlindex.h"
+
+using namespace reader;
+using namespace std;
+
+void XmlScanner::feed(const char *buf, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+	{
+		char ch = buf[i];
+
+		if (!inMarkup)
+		{
+			if (ch != '<')
+			{
+				text.push_back(ch);
+				continue;
+			}
+
+			if (!text.empty())
+			{
+				handler.characters(decodeEntities(text));
+				text.clear();
+			}
+
+			inMarkup = true;
+			quote = 0;
+			markup.clear();
+			continue;
+		}
+
+		if (ch == '>' && !quote && markupComplete())
+		{
+			parseMarkup();
+			inMarkup = false;
+			continue;
+		}
+
+		// Quotes are only relevant inside an element tag.
+		if (!markup.empty() && markup[0] != '!' && markup[0] != '?' && (ch == '"' || ch == '\''))
+		{
+			if (!quote)
+				quote = ch;
+			else if (quote == ch)
+				quote = 0;
+		}
+
+		markup.push_back(ch);
+	}
+}
+
+void XmlScanner::finish()
+{
+	if (!inMarkup && !text.empty())
+		handler.characters(decodeEntities(text));
+
+	reset();
+}
+
+void XmlScanner::reset()
+{
+	text.clear();
+	markup.clear();
+	inMarkup = false;
+	quote = 0;
+}
+
+/*
+ * Tests whether a '>' ends the markup. Comments and CDATA sections may
+ * contain a '>'.
+ */
+bool XmlScanner::markupComplete()
+{
+	if (markup.compare(0, 3, "!--") == 0)
+		return markup.length() >= 5 && markup.compare(markup.length() - 2, 2, "--") == 0;
+
+	if (markup.compare(0, 8, "![CDATA[") == 0)
+		return markup.length() >= 10 && markup.compare(markup.length() - 2, 2, "]]") == 0;
+
+	return true;
+}
+
+void XmlScanner::parseMarkup()
+{
+	if (markup.empty() || markup[0] == '?')
+		return;
+
+	if (markup[0] == '!')
+	{
+		if (markup.compare(0, 8, "![CDATA[") == 0)
+			handler.characters(markup.substr(8, markup.length() - 10));
+
+		return;
+	}
+
+	if (markup[0] == '/')
+	{
+		size_t end = markup.find_first_of(" \t\r\n", 1);
+		handler.endElement(markup.substr(1, end == string::npos ? string::npos : end - 1));
+		return;
+	}
+
+	bool empty = (markup.back() == '/');
+
+	if (empty)
+		markup.pop_back();
+
+	size_t pos = markup.find_first_of(" \t\r\n");
+	string name = markup.substr(0, pos);
+	XML_ATTRS attrs;
+
+	while (pos != string::npos && pos < markup.length())
+	{
+		size_t start = markup.find_first_not_of(" \t\r\n", pos);
+
+		if (start == string::npos)
+			break;
+
+		size_t eq = markup.find('=', start);
+
+		if (eq == string::npos)
+			break;
+
+		size_t q1 = markup.find_first_of("\"'", eq);
+
+		if (q1 == string::npos)
+			break;
+
+		size_t q2 = markup.find(markup[q1], q1 + 1);
+
+		if (q2 == string::npos)
+			break;
+
+		string attr = markup.substr(start, eq - start);
+		size_t last = attr.find_last_not_of(" \t\r\n");
+		attr.erase(last == string::npos ? 0 : last + 1);
+		attrs.push_back(pair<string, string>(attr, decodeEntities(markup.substr(q1 + 1, q2 - q1 - 1))));
+		pos = q2 + 1;
+	}
+
+	handler.startElement(name, attrs);
+
+	if (empty)
+		handler.endElement(name);
+}
+
+string XmlScanner::decodeEntities(const string& str)
+{
+	if (str.find('&') == string::npos)
+		return str;
+
+	string out;
+	size_t pos = 0;
+
+	while (pos < str.length())
+	{
+		size_t amp = str.find('&', pos);
+		size_t semi = (amp == string::npos) ? string::npos : str.find(';', amp);
+
+		if (amp == string::npos || semi == string::npos)
+		{
+			out.append(str, pos, string::npos);
+			break;
+		}
+
+		out.append(str, pos, amp - pos);
+		string ent = str.substr(amp + 1, semi - amp - 1);
+
+		if (ent == "lt")
+			out.push_back('<');
+		else if (ent == "gt")
+			out.push_back('>');
+		else if (ent == "amp")
+			out.push_back('&');
+		else if (ent == "quot")
+			out.push_back('"');
+		else if (ent == "apos")
+			out.push_back('\'');
+		else if (!ent.empty() && ent[0] == '#')
+		{
+			unsigned long cp = (ent.length() > 1 && (ent[1] == 'x' || ent[1] == 'X')) ? strtoul(ent.c_str() + 2, nullptr, 16) : strtoul(ent.c_str() + 1, nullptr, 10);
+
+			// Encode the code point as UTF-8
+			if (cp < 0x80)
+				out.push_back(cp);
+			else if (cp < 0x800)
+			{
+				out.push_back(0xc0 | (cp >> 6));
+				out.push_back(0x80 | (cp & 0x3f));
+			}
+			else if (cp < 0x10000)
+			{
+				out.push_back(0xe0 | (cp >> 12));
+				out.push_back(0x80 | ((cp >> 6) & 0x3f));
+				out.push_back(0x80 | (cp & 0x3f));
+			}
+			else
+			{
+				out.push_back(0xf0 | (cp >> 18));
+				out.push_back(0x80 | ((cp >> 12) & 0x3f));
+				out.push_back(0x80 | ((cp >> 6) & 0x3f));
+				out.push_back(0x80 | (cp & 0x3f));
+			}
+		}
+		else
+			out.append(str, amp, semi - amp + 1);
+
+		pos = semi + 1;
+	}
+
+	return out;
+}
+
+void PanelIndex::beginFile(const string& fn)
+{
+	file = fn;
+	stack.clear();
+	text.clear();
+	inPage = false;
+	fontNumber = -1;
+	scanner.reset();
+}
+
+void PanelIndex::endFile()
+{
+	scanner.finish();
+	inPage = false;
+}
+
+/*
+ * Returns the name of the element \p level steps above the current one.
+ * Level 0 is the current element.
+ */
+const string& PanelIndex::parent(size_t level)
+{
+	static const string none;
+
+	if (level >= stack.size())
+		return none;
+
+	return stack[stack.size() - 1 - level];
+}
+
+void PanelIndex::startElement(const string& name, const XML_ATTRS& attrs)
+{
+	text.clear();
+
+	if (stack.empty() && name == "page")
+	{
+		PAGE page;
+		page.file = file;
+		page.type = "page";
+
+		for (auto itr = attrs.begin(); itr != attrs.end(); ++itr)
+		{
+			if (itr->first == "type" && itr->second == "subpage")
+				page.type = "popup";
+		}
+
+		pages.push_back(page);
+		inPage = true;
+	}
+	else if (inPage && name == "button")
+		pages.back().buttons.push_back(BUTTON());
+	else if (name == "font" && parent(0) == "fontList")
+	{
+		fontNumber = -1;
+
+		for (auto itr = attrs.begin(); itr != attrs.end(); ++itr)
+		{
+			if (itr->first == "number")
+				fontNumber = atoi(itr->second.c_str());
+		}
+	}
+
+	stack.push_back(name);
+}
+
+void PanelIndex::endElement(const string& name)
+{
+	size_t first = text.find_first_not_of(" \t\r\n");
+	string value = (first == string::npos) ? string() : text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+	text.clear();
+
+	if (!stack.empty())
+		stack.pop_back();
+
+	if (inPage && !value.empty())
+	{
+		PAGE& page = pages.back();
+
+		if (parent(0) == "page")
+		{
+			if (name == "pageID")
+				page.id = atoi(value.c_str());
+			else if (name == "name")
+				page.name = value;
+		}
+		else if (parent(0) == "button" && !page.buttons.empty())
+		{
+			if (name == "bi")
+				page.buttons.back().id = atoi(value.c_str());
+			else if (name == "na")
+				page.buttons.back().name = value;
+		}
+
+		if (name == "bm" || name == "mi" || (name == "fileName" && parent(0) == "bitmapEntry"))
+			page.images.insert(value);
+		else if (name == "sd")
+			page.sounds.insert(value);
+		else if (name == "fi")
+			page.fonts.insert(atoi(value.c_str()));
+	}
+	else if (fontNumber >= 0 && parent(0) == "font" && !value.empty())
+	{
+		if (name == "file")
+			fonts[fontNumber].file = value;
+		else if (name == "name")
+			fonts[fontNumber].name = value;
+	}
+}
+
+string PanelIndex::toJson()
+{
+	stringstream js;
+
+	js << "{\n  \"pages\": [";
+
+	for (size_t i = 0; i < pages.size(); ++i)
+	{
+		PAGE& page = pages[i];
+
+		js << (i ? "," : "") << "\n    {\"file\": " << jsonString(page.file) << ", \"type\": \"" << page.type
+		   << "\", \"id\": " << page.id << ", \"name\": " << jsonString(page.name) << ",\n     \"buttons\": [";
+
+		for (size_t j = 0; j < page.buttons.size(); ++j)
+			js << (j ? ", " : "") << "{\"id\": " << page.buttons[j].id << ", \"name\": " << jsonString(page.buttons[j].name) << "}";
+
+		js << "],\n     \"images\": [";
+
+		for (auto itr = page.images.begin(); itr != page.images.end(); ++itr)
+			js << (itr != page.images.begin() ? ", " : "") << jsonString(*itr);
+
+		js << "],\n     \"sounds\": [";
+
+		for (auto itr = page.sounds.begin(); itr != page.sounds.end(); ++itr)
+			js << (itr != page.sounds.begin() ? ", " : "") << jsonString(*itr);
+
+		// Fonts are referenced by their number. The file name is taken from
+		// the font list; it is null if the font is unknown.
+		js << "],\n     \"fonts\": [";
+
+		for (auto itr = page.fonts.begin(); itr != page.fonts.end(); ++itr)
+		{
+			auto f = fonts.find(*itr);
+			js << (itr != page.fonts.begin() ? ", " : "") << "{\"number\": " << *itr << ", \"file\": "
+			   << (f != fonts.end() && !f->second.file.empty() ? jsonString(f->second.file) : "null") << "}";
+		}
+
+		js << "]}";
+	}
+
+	js << "\n  ],\n  \"fonts\": [";
+
+	for (auto itr = fonts.begin(); itr != fonts.end(); ++itr)
+	{
+		js << (itr != fonts.begin() ? "," : "") << "\n    {\"number\": " << itr->first << ", \"file\": " << jsonString(itr->second.file)
+		   << ", \"name\": " << jsonString(itr->second.name) << "}";
+	}
+
+	js << "\n  ]\n}\n";
+	return js.str();
+}
+
+/*
+ * Quotes \p str for JSON. Valid UTF-8 sequences are copied. Any other
+ * byte is taken as Latin-1 and escaped, because the XML files and the
+ * paths are often not UTF-8. The result is always valid JSON.
+ */
+string PanelIndex::jsonString(const string& str)
+{
+	string out = "\"";
+
+	for (size_t i = 0; i < str.length(); ++i)
+	{
+		unsigned char ch = str[i];
+		size_t len = utf8Length(str, i);
+
+		if (ch == '"' || ch == '\\')
+		{
+			out.push_back('\\');
+			out.push_back(ch);
+		}
+		else if (ch < 0x20 || (ch >= 0x80 && len == 0))
+		{
+			char hex[8];
+			snprintf(hex, sizeof(hex), "\\u%04x", ch);
+			out.append(hex);
+		}
+		else if (ch >= 0x80)
+		{
+			out.append(str, i, len);
+			i += len - 1;
+		}
+		else
+			out.push_back(ch);
+	}
+
+	out.push_back('"');
+	return out;
+}
+
+/*
+ * Returns the length of the UTF-8 sequence starting at \p pos, or 0 if it
+ * is no valid sequence.
+ */
+size_t PanelIndex::utf8Length(const string& str, size_t pos)
+{
+	unsigned char ch = str[pos];
+	size_t len;
+	uint32_t min;
+
+	if (ch < 0x80)
+		return 1;
+	else if ((ch & 0xe0) == 0xc0)
+	{
+		len = 2;
+		min = 0x80;
+	}
+	else if ((ch & 0xf0) == 0xe0)
+	{
+		len = 3;
+		min = 0x800;
+	}
+	else if ((ch & 0xf8) == 0xf0)
+	{
+		len = 4;
+		min = 0x10000;
+	}
+	else
+		return 0;
+
+	if (pos + len > str.length())
+		return 0;
+
+	uint32_t cp = ch & (0x7f >> len);
+
+	for (size_t i = 1; i < len; ++i)
+	{
+		unsigned char c = str[pos + i];
+
+		if ((c & 0xc0) != 0x80)
+			return 0;
+
+		cp = (cp << 6) | (c & 0x3f);
+	}
+
+	// Overlong sequences, surrogates and values beyond Unicode are invalid.
+	if (cp < min || (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff)
+		return 0;
+
+	return len;
+}
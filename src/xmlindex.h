@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 by Andreas Theofilu <andreas@theosys.at>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+#ifndef __XMLINDEX_H__
+#define __XMLINDEX_H__
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <utility>
+#include <cstdint>
+
+namespace reader
+{
+	typedef std::vector<std::pair<std::string, std::string>> XML_ATTRS;
+
+	/**
+	 * Receives the events of an XmlScanner.
+	 */
+	class XmlHandler
+	{
+		public:
+			virtual ~XmlHandler() {}
+
+			virtual void startElement(const std::string& name, const XML_ATTRS& attrs) = 0;
+			virtual void endElement(const std::string& name) = 0;
+			virtual void characters(const std::string& text) = 0;
+	};
+
+	/**
+	 * A small streaming (SAX like) XML scanner. The document can be given in
+	 * pieces of any size with feed(). A tag split over two pieces is kept
+	 * until it is complete. Comments, processing instructions and the
+	 * document type are skipped. There is no validation.
+	 */
+	class XmlScanner
+	{
+		XmlHandler& handler;
+		std::string text;
+		std::string markup;
+		bool inMarkup{false};
+		char quote{0};
+
+		public:
+			explicit XmlScanner(XmlHandler& h)
+				: handler{h}
+			{}
+
+			void feed(const char *buf, size_t len);
+			void finish();
+			void reset();
+
+			static std::string decodeEntities(const std::string& str);
+
+		private:
+			bool markupComplete();
+			void parseMarkup();
+	};
+
+	/**
+	 * Collects the pages, popups and buttons of a panel and the names of the
+	 * images, sounds and fonts they use. Every XML file is given to
+	 * beginFile(), feed() and endFile(). The result is written as JSON.
+	 */
+	class PanelIndex : public XmlHandler
+	{
+		struct BUTTON
+		{
+			int id{-1};
+			std::string name;
+		};
+
+		struct PAGE
+		{
+			std::string file;
+			std::string type;
+			int id{-1};
+			std::string name;
+			std::vector<BUTTON> buttons;
+			std::set<std::string> images;
+			std::set<std::string> sounds;
+			std::set<int> fonts;
+		};
+
+		struct FONT
+		{
+			std::string file;
+			std::string name;
+		};
+
+		XmlScanner scanner;
+		std::string file;
+		std::vector<std::string> stack;
+		std::string text;
+		std::vector<PAGE> pages;
+		std::map<int, FONT> fonts;
+		bool inPage{false};
+		int fontNumber{-1};
+
+		public:
+			PanelIndex()
+				: scanner{*this}
+			{}
+
+			void beginFile(const std::string& fn);
+			void feed(const char *buf, size_t len) { scanner.feed(buf, len); }
+			void endFile();
+			std::string toJson();
+			static std::string jsonString(const std::string& str);
+
+			void startElement(const std::string& name, const XML_ATTRS& attrs) override;
+			void endElement(const std::string& name) override;
+			void characters(const std::string& str) override { text.append(str); }
+
+		private:
+			const std::string& parent(size_t level);
+			static size_t utf8Length(const std::string& str, size_t pos);
+	};
+}
+
+#endif